@@ -3,8 +3,10 @@
 #include <cudaGL.h>
 
 #include "rt.cuh"
+#include "scene.cuh"
 
 #include <cassert>
+#include <cmath>
 #include <cstdio>
 
 static bool CUDA_check_error(const char * errMsg)
@@ -138,27 +140,46 @@ bool CUDA_device_info()
     return true;
 }
 
-bool CUDA_init()
+static int initDevice()
 {
     int dev = -1;
     cudaDeviceProp deviceProp = cudaDevicePropDontCare;
     deviceProp.canMapHostMemory = 1;
     cudaChooseDevice(&dev, &deviceProp);
     if (CUDA_check_error("failed to choose device")) {
-        return false;
+        return -1;
     }
     assert(!(dev < 0));
     fprintf(stderr, "CUDA: device %i is chosen\n", dev);
     cudaGetDeviceProperties(&deviceProp, dev);
     if (CUDA_check_error("failed to get device properties")) {
-        return false;
+        return -1;
     }
     if (!deviceProp.canMapHostMemory) {
         fprintf(stderr, "CUDA: device is unable to map host memory\n");
-        return false;
+        return -1;
     }
     cudaSetDeviceFlags(cudaDeviceMapHost);
     if (CUDA_check_error("failed to set device flags")) {
+        return -1;
+    }
+    cudaSetDevice(dev);
+    if (CUDA_check_error("failed to set device")) {
+        return -1;
+    }
+    // context is created here rather than by the first call which needs it, so that callers waiting for initialization do not pay for it
+    cudaFree(nullptr);
+    if (CUDA_check_error("failed to create context")) {
+        return -1;
+    }
+    return dev;
+}
+
+// device is chosen and initialized by the first call, concurrent callers wait for it; subsequent calls make the device current
+bool CUDA_init()
+{
+    static const int dev = initDevice();
+    if (dev < 0) {
         return false;
     }
     cudaSetDevice(dev);
@@ -187,32 +208,692 @@ bool CUDA_unregisterGLBuffer(void * cudaBuf)
     return true;
 }
 
-__global__ void run(float3 * buf, uint * scene, int w, int h)
+__device__ inline float3 operator + (float3 l, float3 r) { return make_float3(l.x + r.x, l.y + r.y, l.z + r.z); }
+__device__ inline float3 operator - (float3 l, float3 r) { return make_float3(l.x - r.x, l.y - r.y, l.z - r.z); }
+__device__ inline float3 operator * (float3 v, float s) { return make_float3(v.x * s, v.y * s, v.z * s); }
+__device__ inline float dot(float3 l, float3 r) { return l.x * r.x + l.y * r.y + l.z * r.z; }
+__device__ inline float3 normalize(float3 v) { return v * rsqrtf(dot(v, v)); }
+__device__ inline float3 toFloat3(const float * v) { return make_float3(v[0], v[1], v[2]); }
+
+// m is row-major 3x4
+__device__ inline float3 transformPoint(const float * m, float3 p)
+{
+    return make_float3(m[0] * p.x + m[1] * p.y + m[2] * p.z + m[3],
+                       m[4] * p.x + m[5] * p.y + m[6] * p.z + m[7],
+                       m[8] * p.x + m[9] * p.y + m[10] * p.z + m[11]);
+}
+
+__device__ inline float3 transformVector(const float * m, float3 v)
+{
+    return make_float3(m[0] * v.x + m[1] * v.y + m[2] * v.z,
+                       m[4] * v.x + m[5] * v.y + m[6] * v.z,
+                       m[8] * v.x + m[9] * v.y + m[10] * v.z);
+}
+
+__device__ inline float3 unproject(const float * m, float x, float y, float z)
+{
+    float w = m[3] * x + m[7] * y + m[11] * z + m[15];
+    return make_float3(m[0] * x + m[4] * y + m[8] * z + m[12],
+                       m[1] * x + m[5] * y + m[9] * z + m[13],
+                       m[2] * x + m[6] * y + m[10] * z + m[14]) * (1.0f / w);
+}
+
+// kernels are specialized for the kind of projection, chosen per frame from the inverse transformation matrix
+enum Projection
+{
+    PerspectiveProjection, // also frustum
+    OrthographicProjection // inverse transformation is affine
+};
+
+__device__ inline float3 unpackColor(std::uint32_t color)
+{
+    return make_float3(((color >> 16) & 0xFF) * (1.0f / 255.0f), ((color >> 8) & 0xFF) * (1.0f / 255.0f), (color & 0xFF) * (1.0f / 255.0f));
+}
+
+// shared by closest-hit and any-hit (shadow, occlusion) traversals: box tests need the inverse direction, point tests need the direction,
+// so a shorter occlusion ray would recompute one of them per test; tmax is not a part of the ray, it is passed by value
+struct Ray
+{
+    float3 origin;
+    float3 direction; // normalized
+    float3 inverseDirection;
+};
+
+__device__ inline Ray makeRay(float3 origin, float3 direction)
+{
+    Ray ray;
+    ray.origin = origin;
+    ray.direction = direction;
+    ray.inverseDirection = make_float3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    return ray;
+}
+
+// entry distance tmin is returned if the box is hit closer than tmax
+__device__ inline bool intersectBox(const SceneBox & box, const Ray & ray, float tmax, float & tmin)
+{
+    float t0 = 0.0f;
+    float t1 = tmax;
+    float x0 = (box.min[0] - ray.origin.x) * ray.inverseDirection.x;
+    float x1 = (box.max[0] - ray.origin.x) * ray.inverseDirection.x;
+    t0 = fmaxf(t0, fminf(x0, x1));
+    t1 = fminf(t1, fmaxf(x0, x1));
+    float y0 = (box.min[1] - ray.origin.y) * ray.inverseDirection.y;
+    float y1 = (box.max[1] - ray.origin.y) * ray.inverseDirection.y;
+    t0 = fmaxf(t0, fminf(y0, y1));
+    t1 = fminf(t1, fmaxf(y0, y1));
+    float z0 = (box.min[2] - ray.origin.z) * ray.inverseDirection.z;
+    float z1 = (box.max[2] - ray.origin.z) * ray.inverseDirection.z;
+    t0 = fmaxf(t0, fminf(z0, z1));
+    t1 = fminf(t1, fmaxf(z0, z1));
+    tmin = t0;
+    return !(t1 < t0);
+}
+
+__device__ inline bool intersectPoint(const ScenePoint & point, float radius, const Ray & ray, float tmax, float & t)
+{
+    float3 oc = toFloat3(point.position) - ray.origin;
+    float b = dot(oc, ray.direction);
+    float discriminant = b * b - (dot(oc, oc) - radius * radius);
+    if (discriminant < 0.0f) {
+        return false;
+    }
+    float s = sqrtf(discriminant);
+    float t0 = b - s;
+    if (!(t0 > 0.0f)) {
+        t0 = b + s; // origin is inside the sphere
+    }
+    if (!(t0 > 0.0f) || !(t0 < tmax)) {
+        return false;
+    }
+    t = t0;
+    return true;
+}
+
+// any hit needs no distance, so the square root is avoided: the same condition as intersectPoint() has, squared
+__device__ inline bool occludedByPoint(const ScenePoint & point, float radius, const Ray & ray, float tmax)
+{
+    float3 oc = toFloat3(point.position) - ray.origin;
+    float b = dot(oc, ray.direction);
+    float c = dot(oc, oc) - radius * radius;
+    float discriminant = b * b - c;
+    if (discriminant < 0.0f) {
+        return false;
+    }
+    if (c > 0.0f) {
+        // origin is outside the sphere: entry b - sqrt(discriminant) is hit if it is ahead and closer than tmax
+        return (b > 0.0f) && ((b < tmax) || ((b - tmax) * (b - tmax) < discriminant));
+    }
+    // origin is inside the sphere: exit b + sqrt(discriminant) is hit if it is ahead and closer than tmax
+    float ahead = tmax - b;
+    return ((b > 0.0f) || (c < 0.0f)) && (ahead > 0.0f) && (discriminant < ahead * ahead);
+}
+
+template< Projection projection >
+__device__ inline Ray primaryRay(const float * m, float x, float y, float & tmax)
+{
+    float3 origin;
+    float3 direction;
+    if (projection == OrthographicProjection) {
+        // all the rays are parallel, so the direction is the same for every pixel
+        float w = 1.0f / m[15];
+        origin = make_float3(m[0] * x + m[4] * y + m[12], m[1] * x + m[5] * y + m[13], m[2] * x + m[6] * y + m[14]) * w;
+        direction = make_float3(m[8], m[9], m[10]) * w;
+    } else {
+        origin = unproject(m, x, y, 0.0f);
+        direction = unproject(m, x, y, 1.0f) - origin;
+    }
+    tmax = sqrtf(dot(direction, direction));
+    return makeRay(origin, direction * (1.0f / tmax));
+}
+
+struct Hit
+{
+    float distance;
+    int point;
+    int instance; // -1 for single scene
+};
+
+struct TraversalCost
+{
+    std::uint32_t nodeVisits;
+    std::uint32_t primitiveTests;
+    std::uint32_t ropeHops;
+};
+
+// costs are counted by kernels of the heatmap mode only
+template< bool counting >
+__device__ inline void count(std::uint32_t & counter)
+{
+    if (counting) {
+        ++counter;
+    }
+}
+
+// scene as seen by traversal: bounds of nodes are either original or refit to the clip region
+// if "clipped" is true, then points are tested against the clip region, and nodes are bounded by clippedBoxes unless it is null (instances are not refit)
+struct SceneView
+{
+    const SceneNode * nodes;
+    const ScenePoint * points;
+    const SceneBox * clippedBoxes;
+    const SceneClip * clip;
+    const float * objectToWorld; // null if the scene is not instanced, clip region is in world coordinates
+    int nodeCount;
+    float radius;
+};
+
+__device__ inline SceneView makeSceneView(const SceneHeader * scene, const RenderParameters & parameters)
+{
+    SceneView view;
+    view.nodes = sceneNodes(scene);
+    view.points = scenePoints(scene);
+    view.clippedBoxes = static_cast< const SceneBox * >(parameters.clippedBoxes);
+    view.clip = &parameters.clip;
+    view.objectToWorld = nullptr;
+    view.nodeCount = int(scene->nodeCount);
+    view.radius = scene->pointRadius;
+    return view;
+}
+
+__device__ inline SceneView makeInstanceView(const SceneInstance & instance, const SceneClip * clip)
+{
+    SceneView view;
+    view.nodes = instance.nodes;
+    view.points = instance.points;
+    view.clippedBoxes = nullptr;
+    view.clip = clip;
+    view.objectToWorld = instance.objectToWorld;
+    view.nodeCount = instance.nodeCount;
+    view.radius = instance.radius;
+    return view;
+}
+
+template< bool clipped >
+__device__ inline bool intersectNode(const SceneView & view, int node, const Ray & ray, float tmax, float & tmin)
+{
+    if (clipped && view.clippedBoxes) {
+        const SceneBox & box = view.clippedBoxes[node];
+        if (box.max[0] < box.min[0]) {
+            return false; // whole subtree is cut away
+        }
+        return intersectBox(box, ray, tmax, tmin);
+    }
+    return intersectBox(view.nodes[node].box, ray, tmax, tmin);
+}
+
+template< bool clipped >
+__device__ inline bool isVisiblePoint(const SceneView & view, const ScenePoint & point)
+{
+    if (!clipped) {
+        return true;
+    }
+    if (view.objectToWorld) {
+        float3 p = transformPoint(view.objectToWorld, toFloat3(point.position));
+        const float position[3] = {p.x, p.y, p.z};
+        return isVisible(*view.clip, position);
+    }
+    return isVisible(*view.clip, point.position);
+}
+
+template< bool clipped >
+__device__ inline bool intersectVisiblePoint(const SceneView & view, std::uint32_t i, const Ray & ray, float tmax, float & t)
+{
+    const ScenePoint & point = view.points[i];
+    return intersectPoint(point, view.radius, ray, tmax, t) && isVisiblePoint< clipped >(view, point);
+}
+
+template< bool clipped >
+__device__ inline bool occludedByVisiblePoint(const SceneView & view, std::uint32_t i, const Ray & ray, float tmax)
+{
+    const ScenePoint & point = view.points[i];
+    return occludedByPoint(point, view.radius, ray, tmax) && isVisiblePoint< clipped >(view, point);
+}
+
+// closest hit: children are visited near first, far ones are postponed on the stack along with their entry distances
+template< bool clipped, bool counting >
+__device__ Hit trace(const SceneView & view, const Ray & ray, float tmax, TraversalCost & cost)
+{
+    Hit hit = {tmax, -1, -1};
+    if (view.nodeCount == 0) {
+        return hit;
+    }
+    const SceneNode * nodes = view.nodes;
+    float tmin = 0.0f;
+    count< counting >(cost.nodeVisits);
+    if (!intersectNode< clipped >(view, 0, ray, hit.distance, tmin)) {
+        return hit;
+    }
+    int stack[sceneMaxDepth];
+    float stackDistances[sceneMaxDepth];
+    int top = 0;
+    int node = 0;
+    for (;;) {
+        const SceneNode & n = nodes[node];
+        if (n.right < 0) {
+            for (std::uint32_t i = n.first; i < n.first + n.count; ++i) {
+                float t = 0.0f;
+                count< counting >(cost.primitiveTests);
+                if (intersectVisiblePoint< clipped >(view, i, ray, hit.distance, t)) {
+                    hit.distance = t;
+                    hit.point = int(i);
+                }
+            }
+        } else {
+            int nearChild = node + 1;
+            int farChild = n.right;
+            float nearDistance = 0.0f;
+            float farDistance = 0.0f;
+            count< counting >(cost.nodeVisits);
+            count< counting >(cost.nodeVisits);
+            bool nearHit = intersectNode< clipped >(view, nearChild, ray, hit.distance, nearDistance);
+            bool farHit = intersectNode< clipped >(view, farChild, ray, hit.distance, farDistance);
+            if (nearHit && farHit) {
+                if (farDistance < nearDistance) {
+                    int child = nearChild;
+                    nearChild = farChild;
+                    farChild = child;
+                    float distance = nearDistance;
+                    nearDistance = farDistance;
+                    farDistance = distance;
+                }
+                assert(top < sceneMaxDepth);
+                stack[top] = farChild;
+                stackDistances[top] = farDistance;
+                ++top;
+                node = nearChild;
+                continue;
+            }
+            if (nearHit || farHit) {
+                node = nearHit ? nearChild : farChild;
+                continue;
+            }
+        }
+        // nearest postponed subtree, which still can contain closer hit
+        bool found = false;
+        while (top > 0) {
+            --top;
+            if (stackDistances[top] < hit.distance) {
+                node = stack[top];
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            break;
+        }
+    }
+    return hit;
+}
+
+// any hit: no stack and no ordering of children, subtrees are left through ropes as soon as they are missed
+template< bool clipped, bool counting >
+__device__ bool occluded(const SceneView & view, const Ray & ray, float tmax, TraversalCost & cost)
+{
+    int node = (view.nodeCount == 0) ? -1 : 0;
+    while (!(node < 0)) {
+        const SceneNode & n = view.nodes[node];
+        float tmin = 0.0f;
+        count< counting >(cost.nodeVisits);
+        if (!intersectNode< clipped >(view, node, ray, tmax, tmin)) {
+            count< counting >(cost.ropeHops);
+            node = n.rope;
+        } else if (n.right < 0) {
+            for (std::uint32_t i = n.first; i < n.first + n.count; ++i) {
+                count< counting >(cost.primitiveTests);
+                if (occludedByVisiblePoint< clipped >(view, i, ray, tmax)) {
+                    return true;
+                }
+            }
+            count< counting >(cost.ropeHops);
+            node = n.rope;
+        } else {
+            node = node + 1;
+        }
+    }
+    return false;
+}
+
+// single scene or instances of scenes under the top level of two-level hierarchy
+struct World
+{
+    SceneView scene; // used if topLevelNodes is null
+    const SceneNode * topLevelNodes;
+    const SceneInstance * instances;
+    const SceneClip * clip;
+};
+
+__device__ inline World makeWorld(const RenderParameters & parameters)
+{
+    World world;
+    world.topLevelNodes = static_cast< const SceneNode * >(parameters.topLevelNodes);
+    world.instances = static_cast< const SceneInstance * >(parameters.instances);
+    world.clip = &parameters.clip;
+    if (!world.topLevelNodes) {
+        world.scene = makeSceneView(static_cast< const SceneHeader * >(parameters.scene), parameters);
+    }
+    return world;
+}
+
+// ray in object coordinates of the instance: its direction is normalized, so distances along it are 1 / scale of the world ones
+__device__ inline Ray objectRay(const SceneInstance & instance, const Ray & ray)
+{
+    return makeRay(transformPoint(instance.worldToObject, ray.origin), transformVector(instance.worldToObject, ray.direction) * instance.scale);
+}
+
+// top level is small, so it is traversed through ropes; instances are visited in the order of the hierarchy, hits shorten the ray
+template< bool clipped, bool counting >
+__device__ Hit traceWorld(const World & world, const Ray & ray, float tmax, TraversalCost & cost)
+{
+    if (!world.topLevelNodes) {
+        return trace< clipped, counting >(world.scene, ray, tmax, cost);
+    }
+    Hit hit = {tmax, -1, -1};
+    int node = 0;
+    while (!(node < 0)) {
+        const SceneNode & n = world.topLevelNodes[node];
+        float tmin = 0.0f;
+        count< counting >(cost.nodeVisits);
+        if (!intersectBox(n.box, ray, hit.distance, tmin)) {
+            count< counting >(cost.ropeHops);
+            node = n.rope;
+        } else if (n.right < 0) {
+            for (std::uint32_t i = n.first; i < n.first + n.count; ++i) {
+                const SceneInstance & instance = world.instances[i];
+                Hit instanceHit = trace< clipped, counting >(makeInstanceView(instance, world.clip), objectRay(instance, ray), hit.distance / instance.scale, cost);
+                if (!(instanceHit.point < 0)) {
+                    hit.distance = instanceHit.distance * instance.scale;
+                    hit.point = instanceHit.point;
+                    hit.instance = int(i);
+                }
+            }
+            count< counting >(cost.ropeHops);
+            node = n.rope;
+        } else {
+            node = node + 1;
+        }
+    }
+    return hit;
+}
+
+template< bool clipped, bool counting >
+__device__ bool occludedWorld(const World & world, const Ray & ray, float tmax, TraversalCost & cost)
+{
+    if (!world.topLevelNodes) {
+        return occluded< clipped, counting >(world.scene, ray, tmax, cost);
+    }
+    int node = 0;
+    while (!(node < 0)) {
+        const SceneNode & n = world.topLevelNodes[node];
+        float tmin = 0.0f;
+        count< counting >(cost.nodeVisits);
+        if (!intersectBox(n.box, ray, tmax, tmin)) {
+            count< counting >(cost.ropeHops);
+            node = n.rope;
+        } else if (n.right < 0) {
+            for (std::uint32_t i = n.first; i < n.first + n.count; ++i) {
+                const SceneInstance & instance = world.instances[i];
+                if (occluded< clipped, counting >(makeInstanceView(instance, world.clip), objectRay(instance, ray), tmax / instance.scale, cost)) {
+                    return true;
+                }
+            }
+            count< counting >(cost.ropeHops);
+            node = n.rope;
+        } else {
+            node = node + 1;
+        }
+    }
+    return false;
+}
+
+__device__ inline float3 cross(float3 l, float3 r)
+{
+    return make_float3(l.y * r.z - l.z * r.y, l.z * r.x - l.x * r.z, l.x * r.y - l.y * r.x);
+}
+
+__device__ inline std::uint32_t hash(std::uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+__device__ inline float toUnitFloat(std::uint32_t x)
+{
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// stored normal if any, otherwise normal of the sphere; either faces the ray
+__device__ inline float3 pointNormal(const ScenePoint & point, const Ray & ray, float3 position)
+{
+    float3 normal = toFloat3(point.normal);
+    if (dot(normal, normal) > 0.0f) {
+        normal = normalize(normal);
+    } else {
+        normal = normalize(position - toFloat3(point.position));
+    }
+    return (dot(normal, ray.direction) > 0.0f) ? (normal * -1.0f) : normal;
+}
+
+// hit point in world coordinates
+struct Surface
+{
+    const ScenePoint * point;
+    float3 position;
+    float3 normal; // faces the ray
+    float radius; // of the points in world coordinates
+};
+
+__device__ inline Surface surface(const World & world, const Ray & ray, const Hit & hit)
+{
+    Surface surface;
+    surface.position = ray.origin + ray.direction * hit.distance;
+    if (hit.instance < 0) {
+        surface.point = &world.scene.points[hit.point];
+        surface.normal = pointNormal(*surface.point, ray, surface.position);
+        surface.radius = world.scene.radius;
+    } else {
+        // similarity transformation keeps normals perpendicular and facing
+        const SceneInstance & instance = world.instances[hit.instance];
+        surface.point = &instance.points[hit.point];
+        float3 normal = pointNormal(*surface.point, objectRay(instance, ray), transformPoint(instance.worldToObject, surface.position));
+        surface.normal = normalize(transformVector(instance.objectToWorld, normal));
+        surface.radius = instance.radius * instance.scale;
+    }
+    return surface;
+}
+
+// secondary rays start above the neighbouring spheres, otherwise dense scans occlude themselves
+__device__ inline float3 offsetOrigin(const Surface & surface)
 {
-    int x = __mul24(blockIdx.x, blockDim.x) + threadIdx.x;
-    int y = __mul24(blockIdx.y, blockDim.y) + threadIdx.y;
-    int index = w * y + x;
-    int resolution = w * h;
-    if (!(index < resolution)) {
+    return surface.position + surface.normal * (2.0f * surface.radius);
+}
+
+template< bool clipped, bool counting >
+__device__ float ambientOcclusion(const World & world, const Shading & shading, const Surface & surface, std::uint32_t seed, TraversalCost & cost)
+{
+    if (!(shading.occlusionSamples > 0)) {
+        return 1.0f;
+    }
+    float3 normal = surface.normal;
+    float3 tangent = normalize(cross((fabsf(normal.x) > 0.5f) ? make_float3(0.0f, 1.0f, 0.0f) : make_float3(1.0f, 0.0f, 0.0f), normal));
+    float3 bitangent = cross(normal, tangent);
+    float3 origin = offsetOrigin(surface);
+    int unoccluded = 0;
+    for (int i = 0; i < shading.occlusionSamples; ++i) {
+        // cosine weighted direction in the hemisphere
+        std::uint32_t h = hash(seed + std::uint32_t(i) * 0x9E3779B9u);
+        float u = toUnitFloat(h);
+        float v = toUnitFloat(hash(h));
+        float r = sqrtf(u);
+        float phi = 6.28318530718f * v;
+        float3 direction = tangent * (r * cosf(phi)) + bitangent * (r * sinf(phi)) + normal * sqrtf(fmaxf(0.0f, 1.0f - u));
+        if (!occludedWorld< clipped, counting >(world, makeRay(origin, direction), shading.occlusionRadius, cost)) {
+            ++unoccluded;
+        }
+    }
+    return float(unoccluded) / float(shading.occlusionSamples);
+}
+
+template< ShadingMode mode, bool clipped, bool counting >
+__device__ float3 shade(const World & world, const Shading & shading, const Ray & ray, const Hit & hit, std::uint32_t seed, TraversalCost & cost)
+{
+    if (hit.point < 0) {
+        return make_float3(0.0f, 0.0f, 0.0f);
+    }
+    Surface s = surface(world, ray, hit);
+    float3 color = unpackColor(s.point->color);
+    float headlight = fmaxf(0.0f, -dot(s.normal, ray.direction));
+    switch (mode) {
+    case ShadowShading : {
+        float3 light = normalize(toFloat3(shading.lightDirection));
+        float lambert = dot(s.normal, light);
+        if ((lambert > 0.0f) && occludedWorld< clipped, counting >(world, makeRay(offsetOrigin(s), light), INFINITY, cost)) {
+            lambert = 0.0f;
+        }
+        return color * (0.2f * headlight + 0.8f * fmaxf(0.0f, lambert));
+    }
+    case AmbientOcclusionShading : {
+        return color * (headlight * ambientOcclusion< clipped, counting >(world, shading, s, seed, cost));
+    }
+    default : {
+        return color * headlight;
+    }
+    }
+}
+
+// blue, cyan, green, yellow, red for t in [0; 1]
+__device__ inline float3 heatColor(float t)
+{
+    t = fminf(fmaxf(t, 0.0f), 1.0f) * 4.0f;
+    float r = fminf(fmaxf(t - 2.0f, 0.0f), 1.0f);
+    float g = fminf(t, 1.0f) - fminf(fmaxf(t - 3.0f, 0.0f), 1.0f);
+    float b = 1.0f - fminf(fmaxf(t - 1.0f, 0.0f), 1.0f);
+    return make_float3(r, g, b);
+}
+
+__device__ inline float3 heatmap(const RenderParameters & parameters, const TraversalCost & cost)
+{
+    std::uint32_t value = 0;
+    switch (parameters.heatmap) {
+    case NodeVisitsHeatmap : {
+        value = cost.nodeVisits;
+        break;
+    }
+    case PrimitiveTestsHeatmap : {
+        value = cost.primitiveTests;
+        break;
+    }
+    case RopeHopsHeatmap : {
+        value = cost.ropeHops;
+        break;
+    }
+    default : {
+        break;
+    }
+    }
+    return heatColor(log2f(1.0f + value) / log2f(1.0f + fmaxf(parameters.heatmapScale, 1.0f)));
+}
+
+__device__ inline int costBin(std::uint32_t value)
+{
+    return (value == 0) ? 0 : min(traversalCostBins - 1, 32 - __clz(int(value)));
+}
+
+__device__ inline void accumulate(TraversalStatistics * statistics, const TraversalCost & cost)
+{
+    if (!statistics) {
         return;
     }
-    float3 & p = buf[index];
-    if (scene) {
-        if ((scene[0] != 1) || (scene[1] != 8) || (scene[2] != 0) || (scene[3] != 42)) {
+    atomicAdd(reinterpret_cast< unsigned long long * >(&statistics->pixels), 1ull);
+    atomicAdd(reinterpret_cast< unsigned long long * >(&statistics->nodeVisits), (unsigned long long)cost.nodeVisits);
+    atomicAdd(reinterpret_cast< unsigned long long * >(&statistics->primitiveTests), (unsigned long long)cost.primitiveTests);
+    atomicAdd(reinterpret_cast< unsigned long long * >(&statistics->ropeHops), (unsigned long long)cost.ropeHops);
+    atomicAdd(&statistics->histograms[0][costBin(cost.nodeVisits)], 1u);
+    atomicAdd(&statistics->histograms[1][costBin(cost.primitiveTests)], 1u);
+    atomicAdd(&statistics->histograms[2][costBin(cost.ropeHops)], 1u);
+}
+
+// every combination is instantiated into renderKernels, so options do not cost branches per pixel
+template< Projection projection, ShadingMode mode, bool clipped, bool counting >
+__global__ void run(float3 * buf, RenderParameters parameters, TraversalStatistics * statistics, int x0, int y0, int tileWidth, int tileHeight)
+{
+    int tx = __mul24(blockIdx.x, blockDim.x) + threadIdx.x;
+    int ty = __mul24(blockIdx.y, blockDim.y) + threadIdx.y;
+    if (!(tx < tileWidth) || !(ty < tileHeight)) {
+        return;
+    }
+    float3 & p = buf[tileWidth * ty + tx];
+    const SceneHeader * scene = static_cast< const SceneHeader * >(parameters.scene);
+    if (!parameters.topLevelNodes) {
+        if (!scene) {
+            p = {1.0f, 1.0f, 1.0f};
+            return;
+        }
+        if (!isSupportedScene(*scene)) {
             p = {1.0f, 0.0f, 0.0f};
-        } else {
-            p = {0.0f, 0.0f, 1.0f};
+            return;
         }
-            /*
-        switch ((index * 3) / resolution) {
-        case 0 : p = {1.0f, 0.0f, 0.0f}; break;
-        case 1 : p = {0.0f, 1.0f, 0.0f}; break;
-        case 2 : p = {0.0f, 0.0f, 1.0f}; break;
-        default : p = {0.0f, 0.0f, 0.0f};
-        }*/
+    }
+    float x = (x0 + tx) + 0.5f;
+    float y = (y0 + ty) + 0.5f;
+    float tmax = 0.0f;
+    Ray ray = primaryRay< projection >(parameters.inverseTransformationMatrix, x, y, tmax);
+    std::uint32_t seed = hash(std::uint32_t(x0 + tx) * 0x8DA6B343u ^ std::uint32_t(y0 + ty) * 0xD8163841u);
+    World world = makeWorld(parameters);
+    TraversalCost cost = {};
+    float3 color = shade< mode, clipped, counting >(world, parameters.shading, ray, traceWorld< clipped, counting >(world, ray, tmax, cost), seed, cost);
+    if (counting) {
+        p = heatmap(parameters, cost);
+        accumulate(statistics, cost);
     } else {
-        p = {1.0f, 1.0f, 1.0f};
+        p = color;
+    }
+}
+
+template< bool clipped >
+__global__ void query(const RayQuery * rays, RayHit * hits, int count, RenderParameters parameters)
+{
+    int i = __mul24(blockIdx.x, blockDim.x) + threadIdx.x;
+    if (!(i < count)) {
+        return;
+    }
+    const RayQuery & rayQuery = rays[i];
+    RayHit & rayHit = hits[i];
+    rayHit = {};
+    rayHit.distance = INFINITY;
+    rayHit.point = -1;
+    rayHit.instance = -1;
+    const SceneHeader * scene = static_cast< const SceneHeader * >(parameters.scene);
+    if (!parameters.topLevelNodes && (!scene || !isSupportedScene(*scene))) {
+        return;
+    }
+    float3 direction = toFloat3(rayQuery.direction);
+    float length = sqrtf(dot(direction, direction));
+    if (!(length > 0.0f)) {
+        return;
     }
+    Ray ray = makeRay(toFloat3(rayQuery.origin), direction * (1.0f / length));
+    World world = makeWorld(parameters);
+    TraversalCost cost = {};
+    Hit hit = traceWorld< clipped, false >(world, ray, rayQuery.tmax, cost);
+    if (hit.point < 0) {
+        return;
+    }
+    Surface s = surface(world, ray, hit);
+    rayHit.distance = hit.distance;
+    rayHit.point = hit.point;
+    rayHit.instance = hit.instance;
+    rayHit.position[0] = s.position.x;
+    rayHit.position[1] = s.position.y;
+    rayHit.position[2] = s.position.z;
+    rayHit.normal[0] = s.normal.x;
+    rayHit.normal[1] = s.normal.y;
+    rayHit.normal[2] = s.normal.z;
+    rayHit.color = s.point->color;
+    rayHit.intensity = s.point->intensity;
 }
 
 inline
@@ -245,7 +926,136 @@ bool CUDA_unregisterBuffer(void * f)
     return true;
 }
 
-bool CUDA_render(void * cudaBuf, void * scene, int w, int h)
+struct DeviceBuffer
+{
+    void * p = nullptr;
+    std::size_t capacity = 0;
+};
+
+// scratch buffers of tiles, ray queries and traversal statistics
+static DeviceBuffer tileBuffer;
+static DeviceBuffer rayBuffer;
+static DeviceBuffer hitBuffer;
+static DeviceBuffer statisticsBuffer;
+
+static void release(DeviceBuffer & buffer)
+{
+    cudaFree(buffer.p);
+    buffer.p = nullptr;
+    buffer.capacity = 0;
+}
+
+// device buffers only grow: consecutive frames and query batches are of similar size
+static bool reserve(DeviceBuffer & buffer, std::size_t size)
+{
+    if (!(buffer.capacity < size)) {
+        return true;
+    }
+    release(buffer);
+    cudaMalloc(&buffer.p, size);
+    if (CUDA_check_error("failed to allocate device buffer")) {
+        return false;
+    }
+    buffer.capacity = size;
+    return true;
+}
+
+std::size_t CUDA_deviceBuffersSize()
+{
+    return tileBuffer.capacity + rayBuffer.capacity + hitBuffer.capacity + statisticsBuffer.capacity;
+}
+
+bool CUDA_releaseDeviceBuffers()
+{
+    release(tileBuffer);
+    release(rayBuffer);
+    release(hitBuffer);
+    release(statisticsBuffer);
+    if (CUDA_check_error("failed to free device buffers")) {
+        return false;
+    }
+    return true;
+}
+
+bool CUDA_deviceMemoryUsed(std::size_t * used)
+{
+    std::size_t free = 0, total = 0;
+    cudaMemGetInfo(&free, &total);
+    if (CUDA_check_error("failed to get memory info")) {
+        return false;
+    }
+    *used = total - free;
+    return true;
+}
+
+using RenderKernel = void (*)(float3 * buf, RenderParameters parameters, TraversalStatistics * statistics, int x0, int y0, int tileWidth, int tileHeight);
+
+// [projection][shading mode][clipped][counting]
+#define RENDER_KERNELS(projection, mode) \
+    {{&run< projection, mode, false, false >, &run< projection, mode, false, true >}, \
+     {&run< projection, mode, true, false >, &run< projection, mode, true, true >}}
+static const RenderKernel renderKernels[2][3][2][2] = {
+    {RENDER_KERNELS(PerspectiveProjection, HeadlightShading), RENDER_KERNELS(PerspectiveProjection, ShadowShading), RENDER_KERNELS(PerspectiveProjection, AmbientOcclusionShading)},
+    {RENDER_KERNELS(OrthographicProjection, HeadlightShading), RENDER_KERNELS(OrthographicProjection, ShadowShading), RENDER_KERNELS(OrthographicProjection, AmbientOcclusionShading)},
+};
+#undef RENDER_KERNELS
+
+static bool isCounting(const RenderParameters & parameters)
+{
+    return (parameters.heatmap > NoHeatmap) && !(parameters.heatmap > RopeHopsHeatmap);
+}
+
+// instances are not refit, but their points are still tested against the clip region
+static bool isClipped(const RenderParameters & parameters)
+{
+    return parameters.clippedBoxes || (parameters.topLevelNodes && isClipping(parameters.clip));
+}
+
+static RenderKernel renderKernel(const RenderParameters & parameters)
+{
+    const float * m = parameters.inverseTransformationMatrix;
+    const bool affine = (m[3] == 0.0f) && (m[7] == 0.0f) && (m[11] == 0.0f);
+    const Projection projection = affine ? OrthographicProjection : PerspectiveProjection;
+    int mode = parameters.shading.mode;
+    if ((mode < 0) || !(mode < 3)) {
+        mode = HeadlightShading;
+    }
+    return renderKernels[projection][mode][isClipped(parameters) ? 1 : 0][isCounting(parameters) ? 1 : 0];
+}
+
+static bool launch(float3 * buf, const RenderParameters & parameters, int x, int y, int tileWidth, int tileHeight, TraversalStatistics * statistics = nullptr)
+{
+    if (!isCounting(parameters)) {
+        statistics = nullptr;
+    }
+    if (statistics) {
+        if (!reserve(statisticsBuffer, sizeof(TraversalStatistics))) {
+            return false;
+        }
+        cudaMemset(statisticsBuffer.p, 0, sizeof(TraversalStatistics));
+        if (CUDA_check_error("failed to clear traversal statistics")) {
+            return false;
+        }
+    }
+    dim3 threadsPerBlock(16, 16);
+    dim3 numBlocks(divUp(tileWidth, threadsPerBlock.x), divUp(tileHeight, threadsPerBlock.y));
+    if (numBlocks.x * numBlocks.y * numBlocks.z > 0) {
+        renderKernel(parameters)<<< numBlocks, threadsPerBlock >>>(buf, parameters, static_cast< TraversalStatistics * >(statistics ? statisticsBuffer.p : nullptr), x, y, tileWidth, tileHeight);
+        cudaDeviceSynchronize();
+        if (CUDA_check_error("failed to launch run() kernel")) {
+            return false;
+        }
+    }
+    if (statistics) {
+        cudaMemcpy(statistics, statisticsBuffer.p, sizeof(TraversalStatistics), cudaMemcpyDeviceToHost);
+        if (CUDA_check_error("failed to copy traversal statistics to host")) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CUDA_render(void * cudaBuf, const RenderParameters & parameters, int w, int h, TraversalStatistics * statistics)
 {
     cudaGraphicsMapResources(1, (cudaGraphicsResource_t *)&cudaBuf);
     if (CUDA_check_error("failed to map resource")) {
@@ -257,17 +1067,53 @@ bool CUDA_render(void * cudaBuf, void * scene, int w, int h)
     if (CUDA_check_error("failed to get device pointer")) {
         return false;
     }
-    assert(w * h * 3 * sizeof(GLfloat) == size);
-    dim3 threadsPerBlock(16, 16);
-    dim3 numBlocks(divUp(w, threadsPerBlock.x), divUp(h, threadsPerBlock.y));
-    if (numBlocks.x * numBlocks.y * numBlocks.z > 0) {
-        run<<< numBlocks, threadsPerBlock >>>(static_cast< float3 * >(devPtr), static_cast< uint * >(scene), w, h);
-        cudaDeviceSynchronize();
-        CUDA_check_error("failed to launch run() kernel");
-    }
+    assert(!(size < w * h * 3 * sizeof(GLfloat)));
+    launch(static_cast< float3 * >(devPtr), parameters, 0, 0, w, h, statistics);
     cudaGraphicsUnmapResources(1, (cudaGraphicsResource_t *)&cudaBuf);
     if (CUDA_check_error("failed to unmap resource")) {
         return false;
     }
     return true;
 }
+
+bool CUDA_renderToHost(void * hostBuf, const RenderParameters & parameters, int x, int y, int tileWidth, int tileHeight)
+{
+    std::size_t size = std::size_t(tileWidth) * tileHeight * sizeof(float3);
+    if (!reserve(tileBuffer, size)) {
+        return false;
+    }
+    if (!launch(static_cast< float3 * >(tileBuffer.p), parameters, x, y, tileWidth, tileHeight)) {
+        return false;
+    }
+    cudaMemcpy(hostBuf, tileBuffer.p, size, cudaMemcpyDeviceToHost);
+    if (CUDA_check_error("failed to copy tile to host")) {
+        return false;
+    }
+    return true;
+}
+
+bool CUDA_raycast(const RayQuery * rays, RayHit * hits, int count, const RenderParameters & parameters)
+{
+    if (!(count > 0)) {
+        return true;
+    }
+    if (!reserve(rayBuffer, count * sizeof(RayQuery)) || !reserve(hitBuffer, count * sizeof(RayHit))) {
+        return false;
+    }
+    cudaMemcpy(rayBuffer.p, rays, count * sizeof(RayQuery), cudaMemcpyHostToDevice);
+    if (CUDA_check_error("failed to copy rays to device")) {
+        return false;
+    }
+    int threadsPerBlock = 256;
+    const auto kernel = isClipped(parameters) ? &query< true > : &query< false >;
+    kernel<<< divUp(count, threadsPerBlock), threadsPerBlock >>>(static_cast< const RayQuery * >(rayBuffer.p), static_cast< RayHit * >(hitBuffer.p), count, parameters);
+    cudaDeviceSynchronize();
+    if (CUDA_check_error("failed to launch query() kernel")) {
+        return false;
+    }
+    cudaMemcpy(hits, hitBuffer.p, count * sizeof(RayHit), cudaMemcpyDeviceToHost);
+    if (CUDA_check_error("failed to copy hits to host")) {
+        return false;
+    }
+    return true;
+}
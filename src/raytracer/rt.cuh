@@ -2,10 +2,120 @@
 
 // include appropriate GL library header first
 
+#include "scene.cuh"
+
+#include <cstddef>
+#include <cstdint>
+
+struct RayQuery
+{
+
+    float origin[3];
+    float direction[3];
+    float tmax;
+
+};
+
+struct RayHit
+{
+
+    float distance; // infinity if nothing is hit
+    std::int32_t point; // index of the point in the scene, -1 if nothing is hit
+    std::int32_t instance; // index of the instance of the scene, -1 if the scene is single or nothing is hit
+    float position[3];
+    float normal[3];
+    std::uint32_t color;
+    float intensity;
+
+};
+
+enum ShadingMode : std::int32_t
+{
+    HeadlightShading,
+    ShadowShading, // directional light, occlusion is tested by any-hit traversal
+    AmbientOcclusionShading
+};
+
+struct Shading
+{
+
+    ShadingMode mode;
+    float lightDirection[3]; // towards the light
+    float occlusionRadius;
+    std::int32_t occlusionSamples;
+
+};
+
+// debug mode: pixels are coloured by the cost of traversals done for them (primary and secondary rays)
+enum TraversalCostHeatmap : std::int32_t
+{
+    NoHeatmap,
+    NodeVisitsHeatmap,
+    PrimitiveTestsHeatmap,
+    RopeHopsHeatmap
+};
+
+enum : int { traversalCostBins = 32 };
+
+// per-frame totals and histograms of per-pixel costs, collected while heatmap is rendered
+struct TraversalStatistics
+{
+
+    std::uint64_t pixels;
+    std::uint64_t nodeVisits;
+    std::uint64_t primitiveTests;
+    std::uint64_t ropeHops;
+    // [node visits, primitive tests, rope hops][bin]: bin 0 counts pixels of zero cost, bin i of cost in [2^(i-1); 2^i)
+    std::uint32_t histograms[3][traversalCostBins];
+
+};
+
+// scene placed into the world by rotation, uniform scale and translation: bottom level of two-level hierarchy
+// instances of the same scene share it
+struct SceneInstance
+{
+
+    const SceneNode * nodes; // device pointers into the scene
+    const ScenePoint * points;
+    std::int32_t nodeCount;
+    float radius; // of the points in object coordinates
+    float scale; // of objectToWorld
+    float objectToWorld[12]; // row-major 3x4
+    float worldToObject[12];
+
+};
+
+struct RenderParameters
+{
+
+    void * scene; // device pointer, ignored if topLevelNodes is not null
+    // two-level hierarchy: device pointer to the top level in the layout of the scene, its leaves refer to instances
+    void * topLevelNodes;
+    void * instances; // device pointer to array of SceneInstance
+    void * clippedBoxes; // device pointer to bounds of nodes refit to the clip region, null if nothing is clipped or there are instances
+    SceneClip clip;
+    Shading shading;
+    TraversalCostHeatmap heatmap;
+    float heatmapScale; // cost at the hot end of the colour scale, which is logarithmic
+    float inverseTransformationMatrix[16]; // column-major, maps window coordinates (pixels, depth in [0; 1]) to world coordinates
+
+};
+
 bool CUDA_device_info();
+// thread-safe, device is initialized once, then it is made current on the calling thread
 bool CUDA_init();
 void * CUDA_registerGLBuffer(GLuint glBuf);
 bool CUDA_unregisterGLBuffer(void * cudaBuf);
 void * CUDA_registerBuffer(void * f, std::size_t size);
 bool CUDA_unregisterBuffer(void * f);
-bool CUDA_render(void * cudaBuf, void * scene, int w, int h);
+// scratch device buffers are grow-only, they can be released between calls to free device memory
+std::size_t CUDA_deviceBuffersSize();
+bool CUDA_releaseDeviceBuffers();
+// memory of the current device in use by all its clients, for measurements
+bool CUDA_deviceMemoryUsed(std::size_t * used);
+// statistics are collected if heatmap is rendered and statistics is not null
+bool CUDA_render(void * cudaBuf, const RenderParameters & parameters, int w, int h, TraversalStatistics * statistics = nullptr);
+// render tile (x, y, tileWidth, tileHeight) of the frame into host buffer of tileWidth * tileHeight RGB float pixels
+bool CUDA_renderToHost(void * hostBuf, const RenderParameters & parameters, int x, int y, int tileWidth, int tileHeight);
+// trace batch of rays with the same traversal as render uses, rays and hits are in host memory
+bool CUDA_raycast(const RayQuery * rays, RayHit * hits, int count, const RenderParameters & parameters);
@@ -0,0 +1,232 @@
+#pragma once
+
+// layout of the scene file, shared by host code and kernels
+// offsets are in bytes from the beginning of the file, arrays are 16 byte aligned
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __CUDACC__
+#define SCENE_FUNCTION __host__ __device__ inline
+#else
+#define SCENE_FUNCTION inline
+#endif
+
+enum : std::uint32_t { sceneVersion = 1 };
+
+struct SceneBox
+{
+
+    float min[3];
+    float max[3];
+
+};
+
+struct SceneHeader
+{
+
+    std::uint32_t signature[4]; // 1, 8, 0, 42
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint32_t nodeCount;
+    std::uint32_t pointCount;
+    std::uint64_t nodeOffset;
+    std::uint64_t pointOffset;
+    SceneBox bounds;
+    float pointRadius; // points are traced as spheres of this radius
+    std::uint32_t reserved[5];
+
+};
+
+// bounding volume hierarchy in depth-first order: left child of inner node immediately follows it,
+// so subtree of node i occupies nodes [i; rope)
+struct SceneNode
+{
+
+    SceneBox box; // encloses spheres of the points
+    std::int32_t right; // index of right child, -1 for leaf
+    std::int32_t rope; // index of the node following the subtree in depth-first order, -1 for the last subtree
+    std::uint32_t first; // leaf: index of the first point
+    std::uint32_t count; // leaf: number of points
+
+};
+
+struct ScenePoint
+{
+
+    float position[3];
+    std::uint32_t color; // 0xRRGGBB
+    float normal[3]; // zero if unknown
+    float intensity;
+
+};
+
+static_assert(sizeof(SceneHeader) == 96, "!");
+static_assert(sizeof(SceneNode) == 40, "!");
+static_assert(sizeof(ScenePoint) == 32, "!");
+
+// depth of the hierarchy produced by builders is limited by traversal stack size
+enum : int { sceneMaxDepth = 64 };
+
+SCENE_FUNCTION
+bool hasSceneSignature(const SceneHeader & header)
+{
+    return (header.signature[0] == 1) && (header.signature[1] == 8) && (header.signature[2] == 0) && (header.signature[3] == 42);
+}
+
+SCENE_FUNCTION
+bool isSupportedScene(const SceneHeader & header)
+{
+    return hasSceneSignature(header) && (header.version == sceneVersion);
+}
+
+SCENE_FUNCTION
+const SceneNode * sceneNodes(const SceneHeader * header)
+{
+    return reinterpret_cast< const SceneNode * >(reinterpret_cast< const unsigned char * >(header) + header->nodeOffset);
+}
+
+SCENE_FUNCTION
+const ScenePoint * scenePoints(const SceneHeader * header)
+{
+    return reinterpret_cast< const ScenePoint * >(reinterpret_cast< const unsigned char * >(header) + header->pointOffset);
+}
+
+enum : int { sceneMaxClipPlanes = 6 };
+
+// points outside of the box (if enabled) or behind any of the planes are cut away
+struct SceneClip
+{
+
+    std::int32_t boxEnabled;
+    std::int32_t planeCount;
+    SceneBox box;
+    float planes[sceneMaxClipPlanes][4]; // point p is behind the plane if dot(plane.xyz, p) + plane.w < 0
+
+};
+
+enum SceneClipClass
+{
+    SceneClipInside,
+    SceneClipPartial,
+    SceneClipOutside
+};
+
+SCENE_FUNCTION
+bool isClipping(const SceneClip & clip)
+{
+    return (clip.boxEnabled != 0) || (clip.planeCount > 0);
+}
+
+SCENE_FUNCTION
+bool isVisible(const SceneClip & clip, const float * position)
+{
+    if (clip.boxEnabled != 0) {
+        for (int i = 0; i < 3; ++i) {
+            if ((position[i] < clip.box.min[i]) || (clip.box.max[i] < position[i])) {
+                return false;
+            }
+        }
+    }
+    for (int i = 0; i < clip.planeCount; ++i) {
+        const float * plane = clip.planes[i];
+        if (plane[0] * position[0] + plane[1] * position[1] + plane[2] * position[2] + plane[3] < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+SCENE_FUNCTION
+SceneClipClass classify(const SceneClip & clip, const SceneBox & box)
+{
+    bool inside = true;
+    if (clip.boxEnabled != 0) {
+        for (int i = 0; i < 3; ++i) {
+            if ((box.max[i] < clip.box.min[i]) || (clip.box.max[i] < box.min[i])) {
+                return SceneClipOutside;
+            }
+            if ((box.min[i] < clip.box.min[i]) || (clip.box.max[i] < box.max[i])) {
+                inside = false;
+            }
+        }
+    }
+    for (int i = 0; i < clip.planeCount; ++i) {
+        const float * plane = clip.planes[i];
+        float lower = plane[3];
+        float upper = plane[3];
+        for (int j = 0; j < 3; ++j) {
+            float a = plane[j] * box.min[j];
+            float b = plane[j] * box.max[j];
+            lower += (a < b) ? a : b;
+            upper += (a < b) ? b : a;
+        }
+        if (upper < 0.0f) {
+            return SceneClipOutside;
+        }
+        if (lower < 0.0f) {
+            inside = false;
+        }
+    }
+    return inside ? SceneClipInside : SceneClipPartial;
+}
+
+// arrays referenced by the header lie within the file of given size, links of nodes are in range
+// and depth of the hierarchy does not exceed traversal stack size
+inline
+bool isConsistentScene(const void * data, std::uint64_t size)
+{
+    if (size < sizeof(SceneHeader)) {
+        return false;
+    }
+    const auto & header = *static_cast< const SceneHeader * >(data);
+    if (!isSupportedScene(header)) {
+        return false;
+    }
+    if (((header.nodeOffset % 16) != 0) || ((header.pointOffset % 16) != 0)) {
+        return false;
+    }
+    if ((size < header.nodeOffset) || ((size - header.nodeOffset) / sizeof(SceneNode) < header.nodeCount)) {
+        return false;
+    }
+    if ((size < header.pointOffset) || ((size - header.pointOffset) / sizeof(ScenePoint) < header.pointCount)) {
+        return false;
+    }
+    const auto nodes = sceneNodes(&header);
+    const auto nodeCount = std::int64_t(header.nodeCount);
+    // children follow their parent, so depth of each node is known before it is visited
+    // depth is one-based, zero marks nodes without parent yet: each node except the root must have exactly one parent
+    std::vector< std::uint8_t > depths(std::size_t(nodeCount), 0);
+    if (nodeCount > 0) {
+        depths.front() = 1;
+    }
+    for (std::int64_t i = 0; i < nodeCount; ++i) {
+        const auto & node = nodes[i];
+        if (depths[std::size_t(i)] == 0) {
+            return false;
+        }
+        if ((node.rope != -1) && !((i < node.rope) && (node.rope < nodeCount))) {
+            return false;
+        }
+        if (node.right < 0) {
+            if ((header.pointCount < node.first) || (header.pointCount - node.first < node.count)) {
+                return false;
+            }
+        } else if (!((i + 1 < node.right) && (node.right < nodeCount))) {
+            return false;
+        } else {
+            const auto depth = std::uint8_t(depths[std::size_t(i)] + 1);
+            if (sceneMaxDepth < depth) {
+                return false;
+            }
+            if ((depths[std::size_t(i + 1)] != 0) || (depths[std::size_t(node.right)] != 0)) {
+                return false;
+            }
+            depths[std::size_t(i + 1)] = depth;
+            depths[std::size_t(node.right)] = depth;
+        }
+    }
+    return true;
+}
@@ -1,5 +1,7 @@
 #include "camera.hpp"
 
+#include <utility>
+
 Q_LOGGING_CATEGORY(cameraCategory, "camera")
 
 CameraLens::CameraLens(QObject * const parent)
@@ -45,23 +47,49 @@ QMatrix4x4 CameraLens::projectionMatrix() const
 Camera::Camera(QObject * const parent)
     : CameraLens{parent}
 {
-    connect(this, &CameraLens::projectionMatrixChanged, this, &Camera::transformationMatrixChanged);
+    connect(this, &CameraLens::projectionMatrixChanged, this, &Camera::invalidateTransformationMatrix);
     const auto o = metaObject();
     const int count = o->propertyCount() - 1;
     Q_ASSERT(!(count < 0));
-    const auto transformationMatrixMetaProperty = o->property(count);
-    Q_ASSERT(transformationMatrixMetaProperty.hasNotifySignal());
-    const int transformationMatrixChangedIndex = transformationMatrixMetaProperty.notifySignalIndex();
-    Q_ASSERT(o->indexOfSignal("transformationMatrixChanged()") == transformationMatrixChangedIndex);
+    Q_ASSERT(o->property(count).notifySignalIndex() == o->indexOfSignal("transformationMatrixChanged()"));
+    const int invalidateTransformationMatrixIndex = o->indexOfSlot("invalidateTransformationMatrix()");
+    Q_ASSERT(!(invalidateTransformationMatrixIndex < 0));
     for (int i = o->propertyOffset(); i < count; ++i) {
         const auto metaProperty = o->property(i);
         Q_ASSERT(metaProperty.hasNotifySignal());
-        if (!QMetaObject::connect(this, metaProperty.notifySignalIndex(), this, transformationMatrixChangedIndex)) {
+        if (!QMetaObject::connect(this, metaProperty.notifySignalIndex(), this, invalidateTransformationMatrixIndex)) {
             qCCritical(cameraCategory);
         }
     }
 }
 
+void Camera::beginUpdate()
+{
+    ++updateDepth;
+}
+
+void Camera::endUpdate()
+{
+    if (!(updateDepth > 0)) {
+        qCWarning(cameraCategory) << "endUpdate() without matching beginUpdate()";
+        return;
+    }
+    if (--updateDepth == 0) {
+        if (std::exchange(transformationMatrixInvalidated, false)) {
+            Q_EMIT transformationMatrixChanged();
+        }
+    }
+}
+
+void Camera::invalidateTransformationMatrix()
+{
+    if (updateDepth > 0) {
+        transformationMatrixInvalidated = true;
+    } else {
+        Q_EMIT transformationMatrixChanged();
+    }
+}
+
 QMatrix4x4 Camera::transformationMatrix() const
 {
     auto transformationMatrix = projectionMatrix();
@@ -70,3 +98,10 @@ QMatrix4x4 Camera::transformationMatrix() const
     transformationMatrix.translate(position);
     return transformationMatrix;
 }
+
+QMatrix4x4 windowToWorldMatrix(const QMatrix4x4 & transformationMatrix, const QSize & size, bool * invertible)
+{
+    QMatrix4x4 viewport;
+    viewport.viewport(0.0f, 0.0f, size.width(), size.height());
+    return (viewport * transformationMatrix).inverted(invertible);
+}
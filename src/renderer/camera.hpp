@@ -93,6 +93,12 @@ public :
     Q_INVOKABLE
     QMatrix4x4 transformationMatrix() const;
 
+    // changes of properties between outermost beginUpdate() and endUpdate() result in single transformationMatrixChanged()
+    Q_INVOKABLE
+    void beginUpdate();
+    Q_INVOKABLE
+    void endUpdate();
+
 Q_SIGNALS :
 
     void positionChanged(QVector3D position);
@@ -101,10 +107,45 @@ Q_SIGNALS :
 
     void transformationMatrixChanged();
 
+private Q_SLOTS :
+
+    void invalidateTransformationMatrix();
+
 private :
 
     QVector3D position = {0.0f, 0.0f, 0.0f};
     QVector3D scale = {1.0f, 1.0f, 1.0f};
     QQuaternion rotation;
 
+    int updateDepth = 0;
+    bool transformationMatrixInvalidated = false;
+
+};
+
+// scoped camera update
+class CameraUpdate
+{
+
+    Camera * const camera;
+
+public :
+
+    explicit
+    CameraUpdate(Camera * const camera)
+        : camera{camera}
+    {
+        camera->beginUpdate();
+    }
+
+    CameraUpdate(const CameraUpdate &) = delete;
+    CameraUpdate & operator = (const CameraUpdate &) = delete;
+
+    ~CameraUpdate()
+    {
+        camera->endUpdate();
+    }
+
 };
+
+// maps window coordinates (pixels from the bottom left corner, depth in [0; 1]) to world coordinates
+QMatrix4x4 windowToWorldMatrix(const QMatrix4x4 & transformationMatrix, const QSize & size, bool * invertible = Q_NULLPTR);
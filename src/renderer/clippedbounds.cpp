@@ -0,0 +1,152 @@
+#include "clippedbounds.hpp"
+
+#include <QtGui>
+
+#include "rt.cuh"
+
+#include <algorithm>
+#include <limits>
+
+#include <cstring>
+
+Q_LOGGING_CATEGORY(clippedBoundsCategory, "clippedBounds")
+
+static SceneBox emptyBox()
+{
+    constexpr auto infinity = std::numeric_limits< float >::infinity();
+    return {{infinity, infinity, infinity}, {-infinity, -infinity, -infinity}};
+}
+
+static bool isEmpty(const SceneBox & box)
+{
+    return box.max[0] < box.min[0];
+}
+
+static void unite(SceneBox & box, const SceneBox & other)
+{
+    for (int i = 0; i < 3; ++i) {
+        box.min[i] = std::min(box.min[i], other.min[i]);
+        box.max[i] = std::max(box.max[i], other.max[i]);
+    }
+}
+
+ClippedBounds::~ClippedBounds()
+{
+    release();
+}
+
+void ClippedBounds::release()
+{
+    if (deviceBoxes) {
+        if (!CUDA_unregisterBuffer(boxes.data())) {
+            qCCritical(clippedBoundsCategory) << "unable to unregister buffer of clipped bounds";
+        }
+        deviceBoxes = Q_NULLPTR;
+    }
+    std::vector< SceneBox >{}.swap(boxes);
+    std::vector< quint8 >{}.swap(classes);
+    reservation.resize(0);
+    scene = Q_NULLPTR;
+    valid = false;
+}
+
+void ClippedBounds::reset(const SceneHeader * scene)
+{
+    release();
+    if (!scene || (scene->nodeCount == 0)) {
+        return;
+    }
+    if (!reservation.tryResize((sizeof(SceneBox) + sizeof(quint8)) * scene->nodeCount)) {
+        qCWarning(clippedBoundsCategory) << "clipped bounds do not fit into memory budget, clipping is disabled";
+        return;
+    }
+    this->scene = scene;
+    const auto nodes = sceneNodes(scene);
+    boxes.reserve(scene->nodeCount);
+    for (quint32 i = 0; i < scene->nodeCount; ++i) {
+        boxes.push_back(nodes[i].box);
+    }
+    classes.assign(scene->nodeCount, quint8(SceneClipInside));
+    deviceBoxes = CUDA_registerBuffer(boxes.data(), sizeof(SceneBox) * boxes.size());
+    if (!deviceBoxes) {
+        qCWarning(clippedBoundsCategory) << "unable to register buffer of clipped bounds, clipping is disabled";
+        std::vector< SceneBox >{}.swap(boxes);
+        std::vector< quint8 >{}.swap(classes);
+        reservation.resize(0);
+        return;
+    }
+    qCDebug(clippedBoundsCategory) << QStringLiteral("%1 bytes are allocated for clipped bounds").arg(sizeof(SceneBox) * boxes.size());
+}
+
+bool ClippedBounds::update(const SceneClip & clip)
+{
+    if (valid && (std::memcmp(&this->clip, &clip, sizeof clip) == 0)) {
+        return false;
+    }
+    const bool wasClipping = valid && isClipping(this->clip);
+    this->clip = clip;
+    if (!deviceBoxes) {
+        valid = true;
+        return false;
+    }
+    if (isClipping(clip)) {
+        // classes of the nodes are meaningful only if boxes are left by the previous refit
+        refit(0, wasClipping);
+        valid = true;
+        return true;
+    }
+    // original bounds are used by traversal, boxes are refit from scratch next time
+    valid = true;
+    return wasClipping;
+}
+
+// known: classes of the node and its descendants reached by the previous refit are up to date
+void ClippedBounds::refit(int node, bool known)
+{
+    const auto nodes = sceneNodes(scene);
+    const SceneNode & n = nodes[node];
+    const auto oldClass = known ? SceneClipClass(classes[node]) : SceneClipPartial;
+    const auto newClass = classify(clip, n.box);
+    classes[node] = quint8(newClass);
+    switch (newClass) {
+    case SceneClipInside : {
+        if (known && (oldClass == SceneClipInside)) {
+            break;
+        }
+        // whole subtree occupies nodes [node; rope)
+        const int end = (n.rope < 0) ? int(scene->nodeCount) : n.rope;
+        std::transform(nodes + node, nodes + end, boxes.begin() + node, [] (const SceneNode & node) { return node.box; });
+        break;
+    }
+    case SceneClipOutside : {
+        // traversal never descends into the subtree
+        boxes[node] = emptyBox();
+        break;
+    }
+    case SceneClipPartial : {
+        const bool knownChildren = known && (oldClass == SceneClipPartial);
+        auto box = emptyBox();
+        if (n.right < 0) {
+            const auto points = scenePoints(scene);
+            const float radius = scene->pointRadius;
+            for (quint32 i = n.first; i < n.first + n.count; ++i) {
+                const auto & position = points[i].position;
+                if (isVisible(clip, position)) {
+                    unite(box, {{position[0] - radius, position[1] - radius, position[2] - radius}, {position[0] + radius, position[1] + radius, position[2] + radius}});
+                }
+            }
+        } else {
+            refit(node + 1, knownChildren);
+            refit(n.right, knownChildren);
+            if (!isEmpty(boxes[node + 1])) {
+                unite(box, boxes[node + 1]);
+            }
+            if (!isEmpty(boxes[n.right])) {
+                unite(box, boxes[n.right]);
+            }
+        }
+        boxes[node] = box;
+        break;
+    }
+    }
+}
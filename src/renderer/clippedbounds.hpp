@@ -0,0 +1,45 @@
+#pragma once
+
+#include "memorybudget.hpp"
+
+#include <QtCore>
+
+#include "scene.cuh"
+
+#include <vector>
+
+Q_DECLARE_LOGGING_CATEGORY(clippedBoundsCategory)
+
+// bounds of the nodes of the scene refit to the clip region, registered for access from the device
+// refit is incremental: subtrees which stay entirely inside or outside of the clip region are not visited
+class ClippedBounds
+{
+
+    const SceneHeader * scene = Q_NULLPTR;
+    std::vector< SceneBox > boxes;
+    std::vector< quint8 > classes; // SceneClipClass of the nodes visited by the previous refit
+    void * deviceBoxes = Q_NULLPTR;
+    MemoryReservation reservation{MemoryBudget::AccelerationData};
+
+    SceneClip clip = {};
+    bool valid = false; // boxes correspond to clip
+
+    void release();
+    void refit(int node, bool known);
+
+public :
+
+    ClippedBounds() = default;
+    ClippedBounds(const ClippedBounds &) = delete;
+    ClippedBounds & operator = (const ClippedBounds &) = delete;
+    ~ClippedBounds();
+
+    // scene is host memory of supported and consistent scene or null
+    void reset(const SceneHeader * scene);
+    // returns true if the bounds have changed
+    bool update(const SceneClip & clip);
+
+    // null if nothing is clipped
+    void * devicePointer() const { return (valid && isClipping(clip)) ? deviceBoxes : Q_NULLPTR; }
+
+};
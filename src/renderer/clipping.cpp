@@ -0,0 +1,18 @@
+#include "clipping.hpp"
+
+Q_LOGGING_CATEGORY(clippingCategory, "clipping")
+
+Clipping::Clipping(QObject * const parent)
+    : QObject{parent}
+{
+    const auto o = metaObject();
+    const int clipChangedIndex = o->indexOfSignal("clipChanged()");
+    Q_ASSERT(!(clipChangedIndex < 0));
+    for (int i = o->propertyOffset(); i < o->propertyCount(); ++i) {
+        const auto metaProperty = o->property(i);
+        Q_ASSERT(metaProperty.hasNotifySignal());
+        if (!QMetaObject::connect(this, metaProperty.notifySignalIndex(), this, clipChangedIndex)) {
+            qCCritical(clippingCategory);
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QtGui>
+
+Q_DECLARE_LOGGING_CATEGORY(clippingCategory)
+
+// clip region of the scene: points outside of the box (if enabled) or behind any of the planes are not rendered
+class Clipping
+        : public QObject
+{
+
+    Q_OBJECT
+
+    Q_PROPERTY(bool boxEnabled MEMBER boxEnabled NOTIFY boxEnabledChanged)
+    Q_PROPERTY(QVector3D boxMinimum MEMBER boxMinimum NOTIFY boxMinimumChanged)
+    Q_PROPERTY(QVector3D boxMaximum MEMBER boxMaximum NOTIFY boxMaximumChanged)
+
+    // list of vector4d (a, b, c, d): point p is behind the plane if a * p.x + b * p.y + c * p.z + d < 0
+    Q_PROPERTY(QVariantList planes MEMBER planes NOTIFY planesChanged)
+
+public :
+
+    explicit
+    Clipping(QObject * const parent = Q_NULLPTR);
+
+Q_SIGNALS :
+
+    void boxEnabledChanged(bool boxEnabled);
+    void boxMinimumChanged(QVector3D boxMinimum);
+    void boxMaximumChanged(QVector3D boxMaximum);
+
+    void planesChanged(QVariantList planes);
+
+    void clipChanged();
+
+private :
+
+    bool boxEnabled = false;
+    QVector3D boxMinimum = {-1.0f, -1.0f, -1.0f};
+    QVector3D boxMaximum = {1.0f, 1.0f, 1.0f};
+
+    QVariantList planes;
+
+};
@@ -1,9 +1,13 @@
 #include "engine.hpp"
+#include "camera.hpp"
 
 #include "rt.cuh"
 
+#include <algorithm>
 #include <utility>
 
+#include <cstring>
+
 Q_LOGGING_CATEGORY(engineCategory, "engine")
 
 static constexpr auto vert = "attribute mediump vec2 position;\n"
@@ -33,36 +37,6 @@ QVector3D rotatedVector(const QQuaternion & q, QVector3D v)
     return v;
 }
 
-bool Engine::map()
-{
-    Q_ASSERT(!f);
-    f = sourceFile.map(0, sourceFile.size(), QFile::MapPrivateOption);
-    if (!f) {
-        qCWarning(engineCategory) << QStringLiteral("unable to map file %1 to memory").arg(sourceFile.fileName());
-        return false;
-    }
-    scene = CUDA_registerBuffer(f, sourceFile.size());
-    return true;
-}
-
-bool Engine::unmap()
-{
-    if (!f) {
-        return true;
-    }
-    scene = Q_NULLPTR;
-    bool success = true;
-    if (!CUDA_unregisterBuffer(f)) {
-        qCCritical(engineCategory) << QStringLiteral("unable to unregister memory mapped buffer for file %1").arg(sourceFile.fileName());
-        success = false;
-    }
-    if (!sourceFile.unmap(std::exchange(f, Q_NULLPTR))) {
-        qCCritical(engineCategory) << QStringLiteral("unable to unmap file %1").arg(sourceFile.fileName());
-        success = false;
-    }
-    return success;
-}
-
 Engine::Engine(QUrl source)
 {
     initializeOpenGLFunctions();
@@ -99,15 +73,15 @@ Engine::Engine(QUrl source)
         program.setAttributeArray(vertexLocation, (const GLfloat *)Q_NULLPTR, 2);
         vbo.release();
     }
-    if (!CUDA_init()) {
-        qCCritical(engineCategory);
-    }
+    initializeBackend();
     setSource(source);
 }
 
 Engine::~Engine()
 {
-    unmap();
+    // opening of the file can not be interrupted
+    loading.waitForFinished();
+    loadingScans.waitForFinished();
     if (cudaBuf) {
         if (!CUDA_unregisterGLBuffer(cudaBuf)) {
             qCCritical(engineCategory());
@@ -121,12 +95,44 @@ Engine::~Engine()
     pixelUnpackBuffer.destroy();
 }
 
-void Engine::init(const QSize & size)
+// RGB float texture with mipmaps and pixel unpack buffer, which only grows
+static quint64 frameBuffersSize(const QSize & size, int pixelUnpackBufferSize)
 {
-    if (cudaBuf) {
-        if (!CUDA_unregisterGLBuffer(cudaBuf)) {
+    const quint64 frameSize = quint64(size.width()) * quint64(size.height()) * 3 * sizeof(GLfloat);
+    return frameSize + frameSize / 3 + qMax(frameSize, quint64(pixelUnpackBufferSize));
+}
+
+// scratch buffers of the kernels are shared by all the engines of the process, so they are accounted once
+static void updateDeviceBuffers()
+{
+    static MemoryReservation deviceBuffers{MemoryBudget::DeviceBuffers};
+    // buffers are grown again by the next frame or query
+    static const int evictor = memoryBudget().addEvictor([]
+    {
+        if (deviceBuffers.size() == 0) {
+            return;
+        }
+        if (!CUDA_releaseDeviceBuffers()) {
             qCCritical(engineCategory);
         }
+        deviceBuffers.resize(0);
+    });
+    Q_UNUSED(evictor);
+    deviceBuffers.resize(CUDA_deviceBuffersSize());
+}
+
+QFuture< bool > Engine::initializeBackend()
+{
+    static const QFuture< bool > initialization = QtConcurrent::run(&CUDA_init);
+    return initialization;
+}
+
+void Engine::init(const QSize & size)
+{
+    viewportSize = size;
+    // pixel unpack buffer is registered for the device, so everything is (re)initialized when the device is ready
+    if (!backendReady) {
+        return;
     }
     if (texture.isCreated()) {
         texture.destroy();
@@ -134,8 +140,31 @@ void Engine::init(const QSize & size)
             qCCritical(engineCategory);
         }
     }
+    frameBuffers.resize(0);
+    fittedBudget = memoryBudget().statistics().budget;
+    QSize frameSize = size;
+    int retainedPixelUnpackBufferSize = pixelUnpackBufferSize;
+    while (!frameBuffers.tryResize(frameBuffersSize(frameSize, retainedPixelUnpackBufferSize))) {
+        // memory retained by grow-only pixel unpack buffer is given up before resolution
+        if (retainedPixelUnpackBufferSize > 0) {
+            retainedPixelUnpackBufferSize = 0;
+            continue;
+        }
+        constexpr int minimalFrameSize = 64;
+        const QSize smallerFrameSize = (frameSize * 0.75).expandedTo({minimalFrameSize, minimalFrameSize}).boundedTo(frameSize);
+        if (smallerFrameSize == frameSize) {
+            frameBuffers.resize(frameBuffersSize(frameSize, retainedPixelUnpackBufferSize));
+            break;
+        }
+        frameSize = smallerFrameSize;
+    }
+    resolutionScale = size.isEmpty() ? 1.0 : qreal(frameSize.width()) / size.width();
+    if (frameSize != size) {
+        qCWarning(engineCategory) << QStringLiteral("frame of size %1x%2 does not fit into memory budget, it is rendered at %3x%4")
+                                     .arg(size.width()).arg(size.height()).arg(frameSize.width()).arg(frameSize.height());
+    }
     texture.setFormat(QOpenGLTexture::TextureFormat::RGB32F);
-    texture.setSize(size.width(), size.height());
+    texture.setSize(frameSize.width(), frameSize.height());
     texture.setAutoMipMapGenerationEnabled(true);
     texture.setMinMagFilters(QOpenGLTexture::LinearMipMapLinear, QOpenGLTexture::Linear);
     texture.setWrapMode(QOpenGLTexture::ClampToEdge);
@@ -143,80 +172,349 @@ void Engine::init(const QSize & size)
     if (!pixelUnpackBuffer.bind()) {
         qCCritical(engineCategory);
     }
-    pixelUnpackBuffer.allocate(texture.width() * texture.height() * 3 * sizeof(GLfloat));
-    cudaBuf = CUDA_registerGLBuffer(pixelUnpackBuffer.bufferId());
-    Q_ASSERT(cudaBuf);
+    // pixel unpack buffer only grows (unless memory budget is exceeded), so it is reallocated and reregistered only if the frame does not fit into it
+    const int frameBufferSize = texture.width() * texture.height() * 3 * sizeof(GLfloat);
+    if ((pixelUnpackBufferSize < frameBufferSize) || (retainedPixelUnpackBufferSize < pixelUnpackBufferSize)) {
+        if (cudaBuf) {
+            if (!CUDA_unregisterGLBuffer(std::exchange(cudaBuf, Q_NULLPTR))) {
+                qCCritical(engineCategory);
+            }
+        }
+        pixelUnpackBuffer.allocate(frameBufferSize);
+        pixelUnpackBufferSize = frameBufferSize;
+        cudaBuf = CUDA_registerGLBuffer(pixelUnpackBuffer.bufferId());
+        Q_ASSERT(cudaBuf);
+        qCDebug(engineCategory) << QStringLiteral("pixel unpack buffer is reallocated: %1 bytes").arg(frameBufferSize);
+    }
     pixelUnpackBuffer.release();
+    updateInverseTransformationMatrix();
+    dirty = true;
 }
 
-void Engine::render()
+void Engine::renderPlaceholder()
 {
-    Q_ASSERT(cudaBuf);
-    if (!CUDA_render(cudaBuf, scene, texture.width(), texture.height())) {
-        qCCritical(engineCategory);
+    glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+// host memory of supported scene, null otherwise
+static const SceneHeader * supportedScene(const SceneFile & sceneFile)
+{
+    const auto scene = reinterpret_cast< const SceneHeader * >(sceneFile.data());
+    if ((sceneFile.size() < qint64(sizeof(SceneHeader))) || !isSupportedScene(*scene)) {
+        return Q_NULLPTR;
     }
-    if (!program.bind()) {
+    return scene;
+}
+
+void Engine::finishLoading()
+{
+    if (!loadingScanSceneFiles.empty() && loadingScans.isFinished()) {
+        // files which fail to open are kept too, so that they are not reopened until their scans are removed
+        for (const auto & loadingScanSceneFile : loadingScanSceneFiles) {
+            if (!loadingScanSceneFile.second->data()) {
+                qCWarning(engineCategory) << QStringLiteral("unable to open scene %1").arg(loadingScanSceneFile.first.toString());
+            } else if (!loadingScanSceneFile.second->pin()) {
+                qCWarning(engineCategory) << QStringLiteral("unable to register scene %1 for the device").arg(loadingScanSceneFile.first.toString());
+            }
+            scanSceneFiles.insert(loadingScanSceneFile.first, loadingScanSceneFile.second);
+        }
+        loadingScanSceneFiles.clear();
+        updateScans();
+    }
+    if (!loadingSceneFile || !loading.isFinished()) {
+        return;
+    }
+    if (sourcePending) {
+        sourcePending = false;
+        loadingSceneFile.reset();
+        if (!(pendingSource == sceneFile->getSource())) {
+            startLoading(pendingSource);
+        }
+        return;
+    }
+    if (!loading.result()) {
+        qCWarning(engineCategory) << QStringLiteral("unable to open scene %1").arg(loadingSource.toString());
+    }
+    // memory of the previous scene is given to the new one, the previous scene is kept if the new one does not fit
+    const bool pinned = (sceneFile->devicePointer() != Q_NULLPTR);
+    if (!sceneFile->unpin()) {
         qCCritical(engineCategory);
     }
-    if (!pixelUnpackBuffer.bind()) {
+    if (!loadingSceneFile->pin() && pinned && sceneFile->pin()) {
+        qCWarning(engineCategory) << QStringLiteral("unable to register scene %1 for the device, scene %2 is kept").arg(loadingSource.toString(), sceneFile->getSource().toString());
+        loadingSceneFile.reset();
+        return;
+    }
+    // previous scene is unmapped here
+    sceneFile = std::move(loadingSceneFile);
+    if (!sceneFile->devicePointer() && sceneFile->data()) {
+        qCWarning(engineCategory) << QStringLiteral("unable to register scene %1 for the device").arg(loadingSource.toString());
+    }
+    dirty = true;
+    // files of unknown format are not refit nor previewed, kernels report them
+    clippedBounds.reset(scene());
+    clippedBounds.update(clip);
+    pointPreview.reset(scene(), previewPointCount);
+}
+
+bool Engine::render()
+{
+    if (!backendReady) {
+        const auto initialization = initializeBackend();
+        if (!initialization.isFinished() || backendFailed) {
+            renderPlaceholder();
+            return false;
+        }
+        // device is made current on the render thread
+        if (!initialization.result() || !CUDA_init()) {
+            qCWarning(engineCategory) << QStringLiteral("no CUDA device capable to map host memory, nothing is rendered");
+            backendFailed = true;
+            renderPlaceholder();
+            return false;
+        }
+        backendReady = true;
+        init(viewportSize);
+    } else if (memoryBudget().statistics().budget != fittedBudget) {
+        init(viewportSize);
+    }
+    finishLoading();
+    // nothing to show before the first scene or scans are opened
+    if ((loadingSceneFile && !sceneFile->data()) || (!loadingScanSceneFiles.empty() && topLevelHierarchy.isEmpty())) {
+        renderPlaceholder();
+        return false;
+    }
+    Q_ASSERT(cudaBuf);
+    // preview is built from the single scene, scans replace it
+    if (preview && dirty && scans.isEmpty() && !pointPreview.isEmpty()) {
+        pointPreview.render(transformationMatrix, viewportSize, clip);
+        return false;
+    }
+    if (!program.bind()) {
         qCCritical(engineCategory);
     }
     texture.bind();
-    texture.setData(QOpenGLTexture::PixelFormat::RGB, QOpenGLTexture::PixelType::Float32, static_cast< const void * >(Q_NULLPTR));
+    // if nothing that affects the image has changed since the previous frame, then texture is reused as is
+    const bool traced = std::exchange(dirty, false);
+    if (traced) {
+        if (!CUDA_render(cudaBuf, renderParameters(), texture.width(), texture.height(), &statistics)) {
+            qCCritical(engineCategory);
+        }
+        updateDeviceBuffers();
+        if (!pixelUnpackBuffer.bind()) {
+            qCCritical(engineCategory);
+        }
+        texture.setData(QOpenGLTexture::PixelFormat::RGB, QOpenGLTexture::PixelType::Float32, static_cast< const void * >(Q_NULLPTR));
+        pixelUnpackBuffer.release();
+    }
     program.setUniformValue(textureLocation, 0);
     {
         QOpenGLVertexArrayObject::Binder vaoBinder(&vao);
         glDrawArrays(GL_TRIANGLES, 0, triangle.size());
     }
     texture.release();
-    pixelUnpackBuffer.release();
     program.release();
+    return traced;
 }
 
-void Engine::setTransformationMatrix(const QMatrix4x4 & transformationMatrix)
+void Engine::updateInverseTransformationMatrix()
 {
-    QMatrix4x4 viewport;
-    viewport.viewport(0, 0, texture.width(), texture.height());
     bool invertible = false;
-    viewport *= transformationMatrix.inverted(&invertible);
+    auto inverse = windowToWorldMatrix(transformationMatrix, {texture.width(), texture.height()}, &invertible);
     if (!invertible) {
         return;
     }
-    inverseTransformationMatrix = qMove(viewport);
+    if (inverseTransformationMatrix == inverse) {
+        return;
+    }
+    inverseTransformationMatrix = qMove(inverse);
+    dirty = true;
+}
+
+const SceneHeader * Engine::scene() const
+{
+    return supportedScene(*sceneFile);
 }
 
-bool Engine::setSource(QUrl source)
+void Engine::updateScans()
 {
-    if (this->source == source) {
-        return true;
+    // file set can not change while it is opened, new sources are picked up when it is finished
+    if (!loadingScanSceneFiles.empty()) {
+        return;
     }
-    this->source = source;
-    if (sourceFile.isOpen()) {
-        sourceFile.close();
-        qCInfo(engineCategory) << QStringLiteral("file %1 is closed").arg(sourceFile.fileName());
-        if (!unmap()) {
-            return false;
+    for (const auto & scan : qAsConst(scans)) {
+        const bool loaded = scanSceneFiles.contains(scan.source);
+        const bool queued = std::any_of(loadingScanSceneFiles.cbegin(), loadingScanSceneFiles.cend(), [&scan] (const std::pair< QUrl, std::shared_ptr< SceneFile > > & loadingScanSceneFile)
+        {
+            return loadingScanSceneFile.first == scan.source;
+        });
+        if (!loaded && !queued) {
+            loadingScanSceneFiles.emplace_back(scan.source, std::make_shared< SceneFile >());
         }
     }
-    if (source.isEmpty()) {
-        return true;
+    if (loadingScanSceneFiles.empty()) {
+        updateTopLevelHierarchy();
+        return;
     }
-    if (!source.isValid()) {
-        qCWarning(engineCategory) << QStringLiteral("URL %1 is invalid").arg(source.toString());
-        return false;
+    loadingScans = QtConcurrent::map(loadingScanSceneFiles, [] (std::pair< QUrl, std::shared_ptr< SceneFile > > & loadingScanSceneFile)
+    {
+        loadingScanSceneFile.second->open(loadingScanSceneFile.first);
+    });
+}
+
+void Engine::updateTopLevelHierarchy()
+{
+    QVector< TopLevelHierarchy::Scan > instances;
+    scanIds.clear();
+    for (int scanId = 0; scanId < scans.size(); ++scanId) {
+        const ScanInstance & scan = scans.at(scanId);
+        const auto scanSceneFile = scanSceneFiles.value(scan.source);
+        Q_ASSERT(scanSceneFile);
+        const auto scene = supportedScene(*scanSceneFile);
+        if (!scene || (scene->nodeCount == 0) || !scanSceneFile->devicePointer()) {
+            continue;
+        }
+        instances.append({scene, scanSceneFile->devicePointer(), scan.transformationMatrix(), scan.scale});
+        scanIds.append(scanId);
     }
-    if (!source.isLocalFile()) {
-        qCWarning(engineCategory) << QStringLiteral("URL %1 is not local file").arg(source.toString());
-        return false;
+    topLevelHierarchy.update(instances);
+    // scenes of removed scans are unregistered and unmapped after the hierarchy stops referring to them
+    for (auto scanSceneFile = scanSceneFiles.begin(); scanSceneFile != scanSceneFiles.end();) {
+        const auto source = scanSceneFile.key();
+        if (std::none_of(scans.cbegin(), scans.cend(), [&source] (const ScanInstance & scan) { return scan.source == source; })) {
+            scanSceneFile = scanSceneFiles.erase(scanSceneFile);
+        } else {
+            ++scanSceneFile;
+        }
+    }
+    dirty = true;
+}
+
+RenderParameters Engine::renderParameters() const
+{
+    RenderParameters parameters = {};
+    if (scans.isEmpty()) {
+        parameters.scene = sceneFile->devicePointer();
+        parameters.clippedBoxes = clippedBounds.devicePointer();
+    } else {
+        // points of the scans are tested against the clip region in world coordinates, their nodes are not refit
+        parameters.topLevelNodes = topLevelHierarchy.nodesDevicePointer();
+        parameters.instances = topLevelHierarchy.instancesDevicePointer();
+    }
+    parameters.clip = clip;
+    parameters.shading = shading;
+    parameters.heatmap = heatmap;
+    parameters.heatmapScale = heatmapScale;
+    std::copy_n(inverseTransformationMatrix.constData(), 16, parameters.inverseTransformationMatrix);
+    return parameters;
+}
+
+void Engine::setTransformationMatrix(const QMatrix4x4 & transformationMatrix)
+{
+    if (this->transformationMatrix == transformationMatrix) {
+        return;
+    }
+    this->transformationMatrix = transformationMatrix;
+    updateInverseTransformationMatrix();
+}
+
+void Engine::startLoading(QUrl source)
+{
+    Q_ASSERT(!loadingSceneFile);
+    loadingSource = source;
+    loadingSceneFile = std::make_unique< SceneFile >();
+    const auto loadingScene = loadingSceneFile.get();
+    loading = QtConcurrent::run([loadingScene, source] { return loadingScene->open(source); });
+}
+
+void Engine::setSource(QUrl source)
+{
+    // it is called while the render thread is blocked, so it never waits for the file being opened
+    if (loadingSceneFile) {
+        sourcePending = !(loadingSource == source);
+        pendingSource = source;
+        return;
+    }
+    if (sceneFile->getSource() == source) {
+        return;
+    }
+    startLoading(source);
+}
+
+void Engine::setScans(const QVector< ScanInstance > & scans)
+{
+    if (this->scans == scans) {
+        return;
+    }
+    this->scans = scans;
+    updateScans();
+}
+
+void Engine::setShading(const Shading & shading)
+{
+    if (std::memcmp(&this->shading, &shading, sizeof shading) == 0) {
+        return;
+    }
+    this->shading = shading;
+    dirty = true;
+}
+
+void Engine::setClip(const SceneClip & clip)
+{
+    if (std::memcmp(&this->clip, &clip, sizeof clip) == 0) {
+        return;
     }
-    sourceFile.setFileName(source.toLocalFile());
-    if (!sourceFile.open(QFile::ReadOnly)) {
-        qCWarning(engineCategory) << QStringLiteral("unable to open file %1 to read").arg(sourceFile.fileName());
+    this->clip = clip;
+    if (clippedBounds.update(clip) || !scans.isEmpty()) {
+        dirty = true;
+    }
+}
+
+void Engine::setHeatmap(TraversalCostHeatmap heatmap, float heatmapScale)
+{
+    if ((this->heatmap == heatmap) && (this->heatmapScale == heatmapScale)) {
+        return;
+    }
+    this->heatmap = heatmap;
+    this->heatmapScale = heatmapScale;
+    dirty = true;
+}
+
+void Engine::setPreview(bool preview, int previewPointCount)
+{
+    this->preview = preview;
+    if (this->previewPointCount == previewPointCount) {
+        return;
+    }
+    this->previewPointCount = previewPointCount;
+    pointPreview.reset(scene(), previewPointCount);
+}
+
+RayQuery Engine::screenRay(const QPointF & point) const
+{
+    const float x = float(point.x() * texture.width());
+    const float y = float(point.y() * texture.height());
+    const auto origin = inverseTransformationMatrix.map(QVector3D{x, y, 0.0f});
+    const auto direction = inverseTransformationMatrix.map(QVector3D{x, y, 1.0f}) - origin;
+    return {{origin.x(), origin.y(), origin.z()}, {direction.x(), direction.y(), direction.z()}, direction.length()};
+}
+
+bool Engine::raycast(const RayQuery * rays, RayHit * hits, int count)
+{
+    if (!backendReady) {
+        qCWarning(engineCategory) << QStringLiteral("device is not ready to trace %1 rays").arg(count);
         return false;
     }
-    if (!map()) {
+    const bool success = CUDA_raycast(rays, hits, count, renderParameters());
+    updateDeviceBuffers();
+    if (!success) {
+        qCWarning(engineCategory) << QStringLiteral("unable to trace %1 rays").arg(count);
         return false;
     }
-    qCInfo(engineCategory) << QStringLiteral("file %1 is open").arg(sourceFile.fileName());
+    // instances are reported as indices of the scans
+    for (int i = 0; i < count; ++i) {
+        const int instanceId = topLevelHierarchy.instanceId(hits[i].instance);
+        hits[i].instance = (instanceId < 0) ? -1 : scanIds.at(instanceId);
+    }
     return true;
 }
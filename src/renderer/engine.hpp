@@ -1,6 +1,20 @@
 #pragma once
 
+#include "scenefile.hpp"
+#include "clippedbounds.hpp"
+#include "pointpreview.hpp"
+#include "scenemanifest.hpp"
+#include "toplevelhierarchy.hpp"
+#include "memorybudget.hpp"
+
 #include <QtGui>
+#include <QtConcurrent>
+
+#include "rt.cuh"
+
+#include <memory>
+#include <utility>
+#include <vector>
 
 Q_DECLARE_LOGGING_CATEGORY(engineCategory)
 
@@ -16,27 +30,105 @@ class Engine
     QOpenGLBuffer vbo;
     QOpenGLVertexArrayObject vao;
     QOpenGLBuffer pixelUnpackBuffer{QOpenGLBuffer::PixelUnpackBuffer};
+    int pixelUnpackBufferSize = 0;
     QOpenGLTexture texture{QOpenGLTexture::Target2D};
     void * cudaBuf = Q_NULLPTR;
 
+    // frame is rendered at lower resolution and scaled up if full one does not fit into memory budget
+    MemoryReservation frameBuffers{MemoryBudget::FrameBuffers};
+    qreal resolutionScale = 1.0;
+    // budget the frame buffers are fitted into, they are refitted when it changes
+    quint64 fittedBudget = 0;
+
+    QMatrix4x4 transformationMatrix;
     QMatrix4x4 inverseTransformationMatrix;
-    QUrl source;
-    QFile sourceFile;
-    uchar * f = Q_NULLPTR;
-    void * scene = Q_NULLPTR;
 
-    bool map();
-    bool unmap();
+    // device is used only after initializeBackend() is finished, placeholder is shown until then
+    bool backendReady = false;
+    // placeholder is shown for good if the device is not usable
+    bool backendFailed = false;
+
+    std::unique_ptr< SceneFile > sceneFile = std::make_unique< SceneFile >();
+    // scene is opened on the thread pool, then it replaces the current one
+    std::unique_ptr< SceneFile > loadingSceneFile;
+    QUrl loadingSource;
+    QFuture< bool > loading;
+    // opening can not be interrupted, so the source requested meanwhile is opened after it and the opened scene is dropped
+    QUrl pendingSource;
+    bool sourcePending = false;
+
+    // scans placed by the manifest are rendered through two-level hierarchy instead of the scene
+    // scene files are shared by the scans with the same source, so repeated geometry is mapped and registered once
+    QVector< ScanInstance > scans;
+    QHash< QUrl, std::shared_ptr< SceneFile > > scanSceneFiles;
+    // scene files of new sources are opened on the thread pool in parallel
+    std::vector< std::pair< QUrl, std::shared_ptr< SceneFile > > > loadingScanSceneFiles;
+    QFuture< void > loadingScans;
+    TopLevelHierarchy topLevelHierarchy;
+    QVector< int > scanIds; // scans of the instances of the top level hierarchy, scans of unsupported scenes are skipped
+
+    Shading shading = {HeadlightShading, {0.0f, 0.0f, 1.0f}, 0.0f, 0};
+    SceneClip clip = {};
+    TraversalCostHeatmap heatmap = NoHeatmap;
+    float heatmapScale = 1.0f;
+    TraversalStatistics statistics = {};
+    ClippedBounds clippedBounds;
+
+    // while the camera moves, the points are splatted instead of tracing
+    PointPreview pointPreview;
+    bool preview = false;
+    int previewPointCount = 0;
+    QSize viewportSize;
+
+    // frame in pixelUnpackBuffer and texture is outdated WRT camera, source, size, shading or clip region
+    // it stays outdated while preview is shown instead, so that the frame is traced when preview ends
+    bool dirty = true;
+
+    void renderPlaceholder();
+    void startLoading(QUrl source);
+    void finishLoading();
+    void updateScans();
+    void updateTopLevelHierarchy();
+    void updateInverseTransformationMatrix();
+    RenderParameters renderParameters() const;
+    // host memory of the current scene, null if it is not supported
+    const SceneHeader * scene() const;
 
 public :
 
+    // starts initialization of the device on the thread pool, subsequent calls return the same future
+    // it is called at startup, so that initialization overlaps loading of QML
+    static QFuture< bool > initializeBackend();
+
     Engine(QUrl source);
     ~Engine();
 
     void init(const QSize & size);
-    void render();
+    // returns true if the frame is traced anew, false if it is reused or preview is splatted
+    bool render();
+
+    // ratio of the size of traced frame to the size requested by init(), less than one if memory budget is exceeded
+    qreal getResolutionScale() const { return resolutionScale; }
 
     void setTransformationMatrix(const QMatrix4x4 & transformationMatrix);
-    bool setSource(QUrl source);
+    // scene is opened asynchronously, current one is rendered until then
+    void setSource(QUrl source);
+    // device or scene is not ready yet, frames should be requested until it is (or until the device turns out to be unusable)
+    bool isLoading() const { return !backendFailed && (!backendReady || loadingSceneFile || !loadingScanSceneFiles.empty()); }
+    // if scans are not empty, then they are rendered instead of the source
+    // if only transformations of the scans change, then the top level hierarchy is refit, otherwise new scenes are opened asynchronously and it is rebuilt
+    void setScans(const QVector< ScanInstance > & scans);
+    void setShading(const Shading & shading);
+    void setClip(const SceneClip & clip);
+    void setHeatmap(TraversalCostHeatmap heatmap, float heatmapScale);
+    // subset of at most previewPointCount points is splatted while preview is enabled and the frame is outdated
+    void setPreview(bool preview, int previewPointCount);
+
+    // of the last frame rendered as heatmap
+    const TraversalStatistics & traversalStatistics() const { return statistics; }
+
+    // ray through the point of the frame, given in coordinates normalized to [0; 1] from the bottom left corner
+    RayQuery screenRay(const QPointF & point) const;
+    bool raycast(const RayQuery * rays, RayHit * hits, int count);
 
 };
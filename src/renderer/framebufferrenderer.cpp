@@ -1,40 +1,222 @@
 #include "framebufferrenderer.hpp"
 
+#include <algorithm>
+#include <utility>
+
 Q_LOGGING_CATEGORY(frameBufferRendererCategory, "frameBufferRenderer")
 
 FrameBufferRenderer::FrameBufferRenderer(bool autoRefresh, QUrl source)
     : autoRefresh{autoRefresh}
-    , engine{source}
-{ ; }
+    , engine{isSceneManifest(source) ? QUrl{} : source}
+{
+    // scratch memory is not in use between frames, when memory is requested
+    frameArenaEvictor = memoryBudget().addEvictor([this]
+    {
+        frameArena.release();
+        frameArenaReservation.resize(0);
+    });
+}
+
+FrameBufferRenderer::~FrameBufferRenderer()
+{
+    memoryBudget().removeEvictor(frameArenaEvictor);
+}
 
 QOpenGLFramebufferObject * FrameBufferRenderer::createFramebufferObject(const QSize & size)
 {
     QOpenGLFramebufferObjectFormat format;
+    format.setAttachment(QOpenGLFramebufferObject::Depth); // for preview
     const auto fbo = new (std::nothrow) QOpenGLFramebufferObject{size, format};
     Q_CHECK_PTR(fbo);
     engine.init(fbo->size());
     return fbo;
 }
 
+static QVariantMap toVariantMap(const RayHit & rayHit)
+{
+    QVariantMap hit;
+    hit.insert(QStringLiteral("distance"), rayHit.distance);
+    hit.insert(QStringLiteral("pointId"), rayHit.point);
+    hit.insert(QStringLiteral("instanceId"), rayHit.instance);
+    if (rayHit.point < 0) {
+        return hit;
+    }
+    hit.insert(QStringLiteral("position"), QVector3D{rayHit.position[0], rayHit.position[1], rayHit.position[2]});
+    hit.insert(QStringLiteral("normal"), QVector3D{rayHit.normal[0], rayHit.normal[1], rayHit.normal[2]});
+    hit.insert(QStringLiteral("color"), QColor{QRgb(rayHit.color)});
+    hit.insert(QStringLiteral("intensity"), rayHit.intensity);
+    return hit;
+}
+
+static QVariantMap toVariantMap(const MemoryBudget::Statistics & statistics)
+{
+    QVariantMap memoryUsage;
+    memoryUsage.insert(QStringLiteral("budget"), statistics.budget);
+    memoryUsage.insert(QStringLiteral("used"), statistics.used);
+    memoryUsage.insert(QStringLiteral("peak"), statistics.peak);
+    for (int category = 0; category < MemoryBudget::CategoryCount; ++category) {
+        memoryUsage.insert(QString::fromLatin1(MemoryBudget::categoryName(MemoryBudget::Category(category))), statistics.categories[category]);
+    }
+    memoryUsage.insert(QStringLiteral("evictions"), statistics.evictions);
+    memoryUsage.insert(QStringLiteral("refusals"), statistics.refusals);
+    return memoryUsage;
+}
+
+static QVariantMap toVariantMap(const TraversalStatistics & statistics)
+{
+    const auto toVariantList = [] (const std::uint32_t (& histogram)[traversalCostBins])
+    {
+        QVariantList bins;
+        bins.reserve(traversalCostBins);
+        for (const auto pixels : histogram) {
+            bins.append(pixels);
+        }
+        return bins;
+    };
+    QVariantMap histograms;
+    histograms.insert(QStringLiteral("nodeVisits"), toVariantList(statistics.histograms[0]));
+    histograms.insert(QStringLiteral("primitiveTests"), toVariantList(statistics.histograms[1]));
+    histograms.insert(QStringLiteral("ropeHops"), toVariantList(statistics.histograms[2]));
+    QVariantMap traversalStatistics;
+    traversalStatistics.insert(QStringLiteral("pixels"), quint64(statistics.pixels));
+    traversalStatistics.insert(QStringLiteral("nodeVisits"), quint64(statistics.nodeVisits));
+    traversalStatistics.insert(QStringLiteral("primitiveTests"), quint64(statistics.primitiveTests));
+    traversalStatistics.insert(QStringLiteral("ropeHops"), quint64(statistics.ropeHops));
+    traversalStatistics.insert(QStringLiteral("histograms"), histograms);
+    return traversalStatistics;
+}
+
+void FrameBufferRenderer::raycast()
+{
+    int count = 0;
+    for (const auto & rayQueryBatch : qAsConst(rayQueryBatches)) {
+        count += rayQueryBatch.screenPoints.size() + rayQueryBatch.rays.size();
+    }
+    frameArena.reset();
+    const auto rays = frameArena.allocate< RayQuery >(count);
+    const auto hits = frameArena.allocate< RayHit >(count);
+    auto ray = rays;
+    for (const auto & rayQueryBatch : qAsConst(rayQueryBatches)) {
+        for (const auto & screenPoint : rayQueryBatch.screenPoints) {
+            *ray++ = engine.screenRay(screenPoint);
+        }
+        ray = std::copy(rayQueryBatch.rays.cbegin(), rayQueryBatch.rays.cend(), ray);
+    }
+    // all the queries since the previous frame are traced in one batch
+    if (!engine.raycast(rays, hits, count)) {
+        std::fill_n(hits, count, RayHit{float(qInf()), -1, -1, {}, {}, 0, 0.0f});
+    }
+    frameArenaReservation.resize(frameArena.statistics().reserved);
+    auto hit = hits;
+    for (const auto & rayQueryBatch : qAsConst(rayQueryBatches)) {
+        QVariantList result;
+        const int size = rayQueryBatch.screenPoints.size() + rayQueryBatch.rays.size();
+        result.reserve(size);
+        for (int i = 0; i < size; ++i) {
+            result.append(toVariantMap(*hit++));
+        }
+        if (renderItem) {
+            if (!QMetaObject::invokeMethod(renderItem, "rayQueryFinished", Qt::QueuedConnection, Q_ARG(int, rayQueryBatch.id), Q_ARG(QVariantList, result))) {
+                qCCritical(frameBufferRendererCategory);
+            }
+        }
+    }
+    rayQueryBatches.clear();
+}
+
 void FrameBufferRenderer::synchronize(QQuickFramebufferObject * const renderItem)
 {
+    this->renderItem = qobject_cast< RenderItem * >(renderItem);
+    if (this->renderItem) {
+        rayQueryBatches += this->renderItem->takeRayQueries();
+    }
     rendererInterface = renderItem->property("renderer").value< QObject * >();
     Q_CHECK_PTR(rendererInterface);
     autoRefresh = rendererInterface->property("autoRefresh").toBool();
+    memoryBudget().setBudget(quint64(qMax(0, rendererInterface->property("memoryBudget").toInt())) << 20);
+    {
+        Shading shading = {};
+        shading.mode = ShadingMode(rendererInterface->property("shadingMode").toInt());
+        const auto lightDirection = rendererInterface->property("lightDirection").value< QVector3D >();
+        shading.lightDirection[0] = lightDirection.x();
+        shading.lightDirection[1] = lightDirection.y();
+        shading.lightDirection[2] = lightDirection.z();
+        shading.occlusionRadius = rendererInterface->property("occlusionRadius").toFloat();
+        shading.occlusionSamples = rendererInterface->property("occlusionSamples").toInt();
+        engine.setShading(shading);
+    }
+    {
+        const auto heatmap = TraversalCostHeatmap(rendererInterface->property("heatmap").toInt());
+        this->heatmap = (heatmap != NoHeatmap);
+        engine.setHeatmap(heatmap, rendererInterface->property("heatmapScale").toFloat());
+    }
+    {
+        const auto clipping = renderItem->property("clipping").value< QObject * >();
+        Q_CHECK_PTR(clipping);
+        SceneClip clip = {};
+        clip.boxEnabled = clipping->property("boxEnabled").toBool() ? 1 : 0;
+        const auto boxMinimum = clipping->property("boxMinimum").value< QVector3D >();
+        const auto boxMaximum = clipping->property("boxMaximum").value< QVector3D >();
+        for (int i = 0; i < 3; ++i) {
+            clip.box.min[i] = boxMinimum[i];
+            clip.box.max[i] = boxMaximum[i];
+        }
+        const auto planes = clipping->property("planes").toList();
+        if (sceneMaxClipPlanes < planes.size()) {
+            qCWarning(frameBufferRendererCategory) << QStringLiteral("only %1 of %2 clip planes are used").arg(int(sceneMaxClipPlanes)).arg(planes.size());
+        }
+        clip.planeCount = qMin(planes.size(), int(sceneMaxClipPlanes));
+        for (int i = 0; i < clip.planeCount; ++i) {
+            const auto plane = planes.at(i).value< QVector4D >();
+            for (int j = 0; j < 4; ++j) {
+                clip.planes[i][j] = plane[j];
+            }
+        }
+        engine.setClip(clip);
+    }
+    {
+        const bool navigating = renderItem->property("navigating").toBool();
+        engine.setPreview(navigating && rendererInterface->property("pointPreview").toBool(), rendererInterface->property("previewPointCount").toInt());
+    }
     engine.setTransformationMatrix(renderItem->property("camera").value< QObject * >()->property("transformationMatrix").value< QMatrix4x4 >());
-    engine.setSource(renderItem->property("source").toUrl());
+    // scans of the manifest replace the scene
+    const auto source = renderItem->property("source").toUrl();
+    engine.setScans(toScanInstances(renderItem->property("scans").toList()));
+    engine.setSource(isSceneManifest(source) ? QUrl{} : source);
 }
 
 void FrameBufferRenderer::render()
 {
     elapsedTimer.start();
-    engine.render();
+    if (engine.render() && heatmap) {
+        const auto & statistics = engine.traversalStatistics();
+        qCDebug(frameBufferRendererCategory) << QStringLiteral("traversal cost per pixel: %1 node visits, %2 primitive tests, %3 rope hops")
+                                                .arg(double(statistics.nodeVisits) / qMax(statistics.pixels, std::uint64_t(1)))
+                                                .arg(double(statistics.primitiveTests) / qMax(statistics.pixels, std::uint64_t(1)))
+                                                .arg(double(statistics.ropeHops) / qMax(statistics.pixels, std::uint64_t(1)));
+        if (rendererInterface) {
+            if (!QMetaObject::invokeMethod(rendererInterface, "updateProperty", Q_ARG(QString, "traversalStatistics"), Q_ARG(QVariant, toVariantMap(statistics)))) {
+                qCCritical(frameBufferRendererCategory);
+            }
+        }
+    }
+    if (!rayQueryBatches.isEmpty()) {
+        raycast();
+    }
     if (rendererInterface) {
+        const auto statistics = memoryBudget().statistics();
+        if (std::exchange(memoryRevision, statistics.revision) != statistics.revision) {
+            auto memoryUsage = toVariantMap(statistics);
+            memoryUsage.insert(QStringLiteral("resolutionScale"), engine.getResolutionScale());
+            if (!QMetaObject::invokeMethod(rendererInterface, "updateProperty", Q_ARG(QString, "memoryUsage"), Q_ARG(QVariant, memoryUsage))) {
+                qCCritical(frameBufferRendererCategory);
+            }
+        }
         if (!QMetaObject::invokeMethod(rendererInterface, "updateProperty", Q_ARG(QString, "dt"), Q_ARG(QVariant, float(elapsedTimer.nsecsElapsed() * 1E-9)))) {
             qCCritical(frameBufferRendererCategory);
         }
     }
-    if (autoRefresh) {
+    if (autoRefresh || engine.isLoading()) {
         update();
     }
 }
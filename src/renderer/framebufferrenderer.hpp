@@ -1,6 +1,10 @@
 #pragma once
 
 #include "engine.hpp"
+#include "renderitem.hpp"
+
+#include "memory.hpp"
+#include "memorybudget.hpp"
 
 #include <QtQuick>
 
@@ -11,15 +15,26 @@ class FrameBufferRenderer
 {
 
     bool autoRefresh;
+    bool heatmap = false;
     Engine engine;
 
     QPointer< QObject > rendererInterface = Q_NULLPTR;
+    QPointer< RenderItem > renderItem = Q_NULLPTR;
 
     QElapsedTimer elapsedTimer;
 
+    QVector< RenderItem::RayQueryBatch > rayQueryBatches;
+    Arena frameArena; // per-frame scratch memory
+    MemoryReservation frameArenaReservation{MemoryBudget::Caches};
+    int frameArenaEvictor = 0;
+    quint64 memoryRevision = 0;
+
+    void raycast();
+
 public :
 
     FrameBufferRenderer(bool autoRefresh, QUrl source);
+    ~FrameBufferRenderer();
 
     QOpenGLFramebufferObject * createFramebufferObject(const QSize & size) Q_DECL_OVERRIDE;
     void synchronize(QQuickFramebufferObject * const renderItem) Q_DECL_OVERRIDE;
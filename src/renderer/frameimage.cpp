@@ -0,0 +1,16 @@
+#include "frameimage.hpp"
+
+QImage frameImage(const float * pixels, const QSize & size)
+{
+    const int width = size.width();
+    const int height = size.height();
+    QImage image{size, QImage::Format_RGB888};
+    for (int y = 0; y < height; ++y) {
+        const auto line = image.scanLine(height - 1 - y);
+        const auto row = pixels + std::size_t(y) * width * 3;
+        for (int x = 0; x < width * 3; ++x) {
+            line[x] = uchar(qBound(0.0f, row[x], 1.0f) * 255.0f + 0.5f);
+        }
+    }
+    return image;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <QtGui>
+
+// RGB float pixels of the frame (rows go from bottom to top) quantized to 8 bits per channel
+QImage frameImage(const float * pixels, const QSize & size);
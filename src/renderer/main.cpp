@@ -1,13 +1,86 @@
+#include "engine.hpp"
 #include "renderitem.hpp"
+#include "tilecoordinator.hpp"
+#include "tileworker.hpp"
 
 #include "qmlinstance.hpp"
 #include "clipboard.hpp"
 
+#include "rt.cuh"
+
 #include <QtQuickControls2>
 
 Q_DECLARE_LOGGING_CATEGORY(rendererCategory)
 Q_LOGGING_CATEGORY(rendererCategory, "renderer")
 
+// coordinator/worker sort-first rendering without GUI
+static int headless(int argc, char * argv [])
+{
+    QCoreApplication application{argc, argv};
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Headless rendering: coordinator splits frames into strips rendered by worker processes"));
+    parser.addHelpOption();
+    const QCommandLineOption workerOption{QStringLiteral("worker"), QStringLiteral("Run as worker connected to coordinator at <address>."), QStringLiteral("address")};
+    const QCommandLineOption coordinatorOption{QStringLiteral("coordinator"), QStringLiteral("Run as coordinator.")};
+    const QCommandLineOption listenOption{QStringLiteral("listen"), QStringLiteral("Local socket name or host:port to listen for workers on."), QStringLiteral("address")};
+    const QCommandLineOption spawnOption{QStringLiteral("spawn"), QStringLiteral("Number of local worker processes to start."), QStringLiteral("count"), QStringLiteral("2")};
+    const QCommandLineOption workersOption{QStringLiteral("workers"), QStringLiteral("Number of workers to wait for before the first frame."), QStringLiteral("count")};
+    const QCommandLineOption sourceOption{QStringLiteral("source"), QStringLiteral("Scene file."), QStringLiteral("file")};
+    const QCommandLineOption sizeOption{QStringLiteral("size"), QStringLiteral("Frame size."), QStringLiteral("width>x<height"), QStringLiteral("1024x768")};
+    const QCommandLineOption framesOption{QStringLiteral("frames"), QStringLiteral("Number of frames to render."), QStringLiteral("count"), QStringLiteral("1")};
+    const QCommandLineOption outputOption{QStringLiteral("output"), QStringLiteral("Image file to save the last frame to."), QStringLiteral("file")};
+    parser.addOptions({workerOption, coordinatorOption, listenOption, spawnOption, workersOption, sourceOption, sizeOption, framesOption, outputOption});
+    parser.process(application);
+
+    if (parser.isSet(workerOption)) {
+        if (!CUDA_init()) {
+            qCCritical(rendererCategory) << "unable to initialize CUDA";
+        }
+        TileWorker tileWorker;
+        QObject::connect(&tileWorker, &TileWorker::finished, &application, &QCoreApplication::quit);
+        if (!tileWorker.connectToCoordinator(parser.value(workerOption))) {
+            return EXIT_FAILURE;
+        }
+        return application.exec();
+    }
+
+    const auto size = parser.value(sizeOption).split(QLatin1Char('x'));
+    const QSize frameSize{size.value(0).toInt(), size.value(size.size() - 1).toInt()};
+    if ((size.size() != 2) || frameSize.isEmpty()) {
+        qCWarning(rendererCategory) << QStringLiteral("invalid frame size %1").arg(parser.value(sizeOption));
+        return EXIT_FAILURE;
+    }
+    const int spawn = parser.value(spawnOption).toInt();
+    const int workers = parser.isSet(workersOption) ? parser.value(workersOption).toInt() : spawn;
+    if (!(workers > 0)) {
+        qCWarning(rendererCategory) << "at least one worker is required";
+        return EXIT_FAILURE;
+    }
+
+    TileCoordinator tileCoordinator;
+    tileCoordinator.setProperty("source", QUrl::fromUserInput(parser.value(sourceOption), QDir::currentPath(), QUrl::AssumeLocalFile));
+    tileCoordinator.setProperty("frameSize", frameSize);
+    tileCoordinator.setProperty("frameCount", parser.value(framesOption).toInt());
+    tileCoordinator.setProperty("workerCount", workers);
+    tileCoordinator.setProperty("output", parser.value(outputOption));
+    QObject::connect(&tileCoordinator, &TileCoordinator::finished, &application, [] (bool success)
+    {
+        QCoreApplication::exit(success ? EXIT_SUCCESS : EXIT_FAILURE);
+    });
+    auto address = parser.value(listenOption);
+    if (address.isEmpty()) {
+        address = QStringLiteral(PROJECT_NAME "-%1").arg(QCoreApplication::applicationPid());
+    }
+    if (!tileCoordinator.listen(address)) {
+        return EXIT_FAILURE;
+    }
+    if (!tileCoordinator.spawnWorkers(spawn)) {
+        return EXIT_FAILURE;
+    }
+    return application.exec();
+}
+
 int main(int argc, char * argv [])
 {
     if (!qputenv("QT_FATAL_CRITICALS", QByteArrayLiteral("1"))) {
@@ -44,14 +117,25 @@ int main(int argc, char * argv [])
     QCoreApplication::setApplicationName(PROJECT_NAME);
     QCoreApplication::setApplicationVersion(PROJECT_VERSION);
 
+    for (int i = 1; i < argc; ++i) {
+        const auto argument = QByteArray::fromRawData(argv[i], int(qstrlen(argv[i])));
+        if (argument.startsWith("--worker") || argument.startsWith("--coordinator")) {
+            return headless(argc, argv);
+        }
+    }
+
     QGuiApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
 
     QGuiApplication application{argc, argv};
 
+    // device is initialized concurrently with loading of QML, the first frames show placeholder until it is ready
+    Engine::initializeBackend();
+
     qmlRegisterSingletonType< Clipboard >("Clipboard", 1, 0, "Clipboard", &instance< Clipboard >);
     qmlRegisterType< RendererInterface >("Renderer", 1, 0, "RendererInterface");
     qmlRegisterType< CameraLens >("Renderer", 1, 0, "CameraLens");
     qmlRegisterType< Camera >("Renderer", 1, 0, "Camera");
+    qmlRegisterType< Clipping >("Renderer", 1, 0, "Clipping");
     qmlRegisterType< RenderItem >("Renderer", 1, 0, "RenderItem");
 
     //qDebug() << QQuickStyle::availableStyles();
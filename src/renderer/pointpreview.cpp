@@ -0,0 +1,212 @@
+#include "pointpreview.hpp"
+
+#include <vector>
+
+#include <cmath>
+#include <cstddef>
+
+Q_LOGGING_CATEGORY(pointPreviewCategory, "pointPreview")
+
+// points hidden by the clip region are moved out of the depth range
+static constexpr auto vert = "attribute highp vec3 position;\n"
+                             "attribute lowp vec4 color;\n" // bytes of 0xRRGGBB in little endian order
+                             "attribute lowp vec4 normal;\n" // zero if unknown
+                             "uniform highp mat4 transformationMatrix;\n"
+                             "uniform highp vec4 eye;\n" // homogeneous, direction towards the eye for orthographic projection
+                             "uniform highp float pointSize;\n" // diameter of the splat in pixels at unit w
+                             "uniform bool boxEnabled;\n"
+                             "uniform highp vec3 boxMinimum;\n"
+                             "uniform highp vec3 boxMaximum;\n"
+                             "uniform int planeCount;\n"
+                             "uniform highp vec4 planes[6];\n"
+                             "varying lowp vec3 pointColor;\n"
+                             "void main()\n"
+                             "{\n"
+                             "    bool visible = !boxEnabled || (all(greaterThanEqual(position, boxMinimum)) && all(lessThanEqual(position, boxMaximum)));\n"
+                             "    for (int i = 0; i < 6; ++i) {\n"
+                             "        if ((i < planeCount) && (dot(planes[i].xyz, position) + planes[i].w < 0.0)) {\n"
+                             "            visible = false;\n"
+                             "        }\n"
+                             "    }\n"
+                             "    if (!visible) {\n"
+                             "        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);\n"
+                             "        gl_PointSize = 1.0;\n"
+                             "        pointColor = vec3(0.0);\n"
+                             "        return;\n"
+                             "    }\n"
+                             "    gl_Position = transformationMatrix * vec4(position, 1.0);\n"
+                             "    gl_PointSize = clamp(pointSize / gl_Position.w, 1.0, 64.0);\n"
+                             "    highp float headlight = 1.0;\n"
+                             "    if (dot(normal.xyz, normal.xyz) > 0.0) {\n"
+                             "        headlight = abs(dot(normalize(normal.xyz), normalize(eye.xyz - position * eye.w)));\n"
+                             "    }\n"
+                             "    pointColor = color.bgr * headlight;\n"
+                             "}\n";
+static constexpr auto frag = "varying lowp vec3 pointColor;\n"
+                             "void main()\n"
+                             "{\n"
+                             "    mediump vec2 p = gl_PointCoord * 2.0 - 1.0;\n"
+                             "    if (dot(p, p) > 1.0) {\n"
+                             "        discard;\n"
+                             "    }\n"
+                             "    gl_FragColor = vec4(pointColor, 1.0);\n"
+                             "}\n";
+
+// desktop compatibility profile only
+#ifndef GL_PROGRAM_POINT_SIZE
+#define GL_PROGRAM_POINT_SIZE 0x8642
+#endif
+#ifndef GL_POINT_SPRITE
+#define GL_POINT_SPRITE 0x8861
+#endif
+
+struct PreviewPoint
+{
+
+    GLfloat position[3];
+    quint32 color;
+    qint8 normal[4];
+
+};
+
+static_assert(sizeof(PreviewPoint) == 20, "!");
+
+PointPreview::PointPreview()
+{
+    initializeOpenGLFunctions();
+    if (!program.addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, vert)) {
+        qCCritical(pointPreviewCategory);
+    }
+    if (!program.addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, frag)) {
+        qCCritical(pointPreviewCategory);
+    }
+    if (!program.link()) {
+        qCCritical(pointPreviewCategory);
+    }
+    positionLocation = program.attributeLocation("position");
+    Q_ASSERT(!(positionLocation < 0));
+    colorLocation = program.attributeLocation("color");
+    Q_ASSERT(!(colorLocation < 0));
+    normalLocation = program.attributeLocation("normal");
+    Q_ASSERT(!(normalLocation < 0));
+    transformationMatrixLocation = program.uniformLocation("transformationMatrix");
+    eyeLocation = program.uniformLocation("eye");
+    pointSizeLocation = program.uniformLocation("pointSize");
+    boxEnabledLocation = program.uniformLocation("boxEnabled");
+    boxMinimumLocation = program.uniformLocation("boxMinimum");
+    boxMaximumLocation = program.uniformLocation("boxMaximum");
+    planeCountLocation = program.uniformLocation("planeCount");
+    planesLocation = program.uniformLocation("planes");
+    if (!vbo.create()) {
+        qCCritical(pointPreviewCategory);
+    }
+    if (!vao.create()) {
+        qCCritical(pointPreviewCategory);
+    }
+    QOpenGLVertexArrayObject::Binder vaoBinder(&vao);
+    if (!vbo.bind()) {
+        qCCritical(pointPreviewCategory);
+    }
+    program.enableAttributeArray(positionLocation);
+    program.setAttributeBuffer(positionLocation, GL_FLOAT, offsetof(PreviewPoint, position), 3, sizeof(PreviewPoint));
+    program.enableAttributeArray(colorLocation);
+    program.setAttributeBuffer(colorLocation, GL_UNSIGNED_BYTE, offsetof(PreviewPoint, color), 4, sizeof(PreviewPoint));
+    program.enableAttributeArray(normalLocation);
+    program.setAttributeBuffer(normalLocation, GL_BYTE, offsetof(PreviewPoint, normal), 4, sizeof(PreviewPoint));
+    vbo.release();
+}
+
+PointPreview::~PointPreview()
+{
+    vao.destroy();
+    vbo.destroy();
+}
+
+void PointPreview::reset(const SceneHeader * scene, int maxPointCount)
+{
+    pointCount = 0;
+    reservation.resize(0);
+    if (!scene || (scene->pointCount == 0) || !(maxPointCount > 0)) {
+        return;
+    }
+    int count = int(qMin(quint64(scene->pointCount), quint64(maxPointCount)));
+    while (!reservation.tryResize(quint64(count) * sizeof(PreviewPoint))) {
+        count /= 2;
+        if (count == 0) {
+            qCWarning(pointPreviewCategory) << "point preview does not fit into memory budget, it is disabled";
+            return;
+        }
+    }
+    std::vector< PreviewPoint > previewPoints;
+    previewPoints.reserve(std::size_t(count));
+    const auto points = scenePoints(scene);
+    for (int i = 0; i < count; ++i) {
+        const ScenePoint & point = points[quint64(i) * scene->pointCount / quint64(count)];
+        PreviewPoint previewPoint = {};
+        for (int j = 0; j < 3; ++j) {
+            previewPoint.position[j] = point.position[j];
+            previewPoint.normal[j] = qint8(qRound(qBound(-1.0f, point.normal[j], 1.0f) * 127.0f));
+        }
+        previewPoint.color = point.color;
+        previewPoints.push_back(previewPoint);
+    }
+    if (!vbo.bind()) {
+        qCCritical(pointPreviewCategory);
+    }
+    vbo.allocate(previewPoints.data(), count * int(sizeof(PreviewPoint)));
+    vbo.release();
+    pointCount = count;
+    // skipped points leave gaps, density of the subset on surfaces is lower by the ratio of the counts
+    pointRadius = scene->pointRadius * std::sqrt(float(scene->pointCount) / float(count));
+    qCDebug(pointPreviewCategory) << QStringLiteral("%1 of %2 points are uploaded for preview").arg(count).arg(scene->pointCount);
+}
+
+void PointPreview::render(const QMatrix4x4 & transformationMatrix, const QSize & viewportSize, const SceneClip & clip)
+{
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glDepthMask(GL_TRUE);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (pointCount == 0) {
+        return;
+    }
+    if (!program.bind()) {
+        qCCritical(pointPreviewCategory);
+    }
+    program.setUniformValue(transformationMatrixLocation, transformationMatrix);
+    // camera centre is the point mapped to zero w with x and y, it is at infinity for orthographic projection
+    program.setUniformValue(eyeLocation, transformationMatrix.inverted() * QVector4D{0.0f, 0.0f, 1.0f, 0.0f});
+    // rotation of the view does not change length of the row, so it is the scale of y of the projection
+    const float projectionScale = transformationMatrix.row(1).toVector3D().length();
+    program.setUniformValue(pointSizeLocation, pointRadius * projectionScale * viewportSize.height());
+    program.setUniformValue(boxEnabledLocation, GLint(clip.boxEnabled != 0));
+    program.setUniformValue(boxMinimumLocation, QVector3D{clip.box.min[0], clip.box.min[1], clip.box.min[2]});
+    program.setUniformValue(boxMaximumLocation, QVector3D{clip.box.max[0], clip.box.max[1], clip.box.max[2]});
+    program.setUniformValue(planeCountLocation, GLint(clip.planeCount));
+    QVector4D planes[sceneMaxClipPlanes];
+    for (int i = 0; i < clip.planeCount; ++i) {
+        planes[i] = {clip.planes[i][0], clip.planes[i][1], clip.planes[i][2], clip.planes[i][3]};
+    }
+    program.setUniformValueArray(planesLocation, planes, sceneMaxClipPlanes);
+    const auto context = QOpenGLContext::currentContext();
+    const bool compatibilityProfile = !context->isOpenGLES() && (context->format().profile() != QSurfaceFormat::CoreProfile);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    if (!context->isOpenGLES()) {
+        glEnable(GL_PROGRAM_POINT_SIZE);
+    }
+    if (compatibilityProfile) {
+        glEnable(GL_POINT_SPRITE);
+    }
+    {
+        QOpenGLVertexArrayObject::Binder vaoBinder(&vao);
+        glDrawArrays(GL_POINTS, 0, pointCount);
+    }
+    if (compatibilityProfile) {
+        glDisable(GL_POINT_SPRITE);
+    }
+    if (!context->isOpenGLES()) {
+        glDisable(GL_PROGRAM_POINT_SIZE);
+    }
+    glDisable(GL_DEPTH_TEST);
+    program.release();
+}
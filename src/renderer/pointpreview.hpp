@@ -0,0 +1,55 @@
+#pragma once
+
+#include "memorybudget.hpp"
+
+#include <QtGui>
+
+#include "scene.cuh"
+
+Q_DECLARE_LOGGING_CATEGORY(pointPreviewCategory)
+
+// cheap preview of the scene while the camera moves: subset of the points is splatted into current framebuffer by GL with depth test
+// points follow leaves of the hierarchy, so uniform subset of them is spatially uniform too; splats of the subset are enlarged to cover the gaps
+// cost of the frame is bounded by the size of the subset, not of the scene
+class PointPreview
+        : protected QOpenGLFunctions
+{
+
+    QOpenGLShaderProgram program;
+
+    int positionLocation = -1;
+    int colorLocation = -1;
+    int normalLocation = -1;
+    int transformationMatrixLocation = -1;
+    int eyeLocation = -1;
+    int pointSizeLocation = -1;
+    int boxEnabledLocation = -1;
+    int boxMinimumLocation = -1;
+    int boxMaximumLocation = -1;
+    int planeCountLocation = -1;
+    int planesLocation = -1;
+
+    QOpenGLBuffer vbo;
+    QOpenGLVertexArrayObject vao;
+    MemoryReservation reservation{MemoryBudget::FrameBuffers};
+
+    int pointCount = 0;
+    float pointRadius = 0.0f; // of the splats
+
+public :
+
+    PointPreview();
+    PointPreview(const PointPreview &) = delete;
+    PointPreview & operator = (const PointPreview &) = delete;
+    ~PointPreview();
+
+    // scene is host memory of supported and consistent scene or null
+    // subset is halved until it fits into memory budget
+    void reset(const SceneHeader * scene, int maxPointCount);
+
+    bool isEmpty() const { return pointCount == 0; }
+
+    // clears current framebuffer (it should have depth attachment) and splats the points into it
+    void render(const QMatrix4x4 & transformationMatrix, const QSize & viewportSize, const SceneClip & clip);
+
+};
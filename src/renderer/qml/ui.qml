@@ -105,6 +105,35 @@ ApplicationWindow {
                 onClicked: renderItem.grabToClipboard()
                 Layout.alignment: Qt.AlignVCenter | Qt.AlignLeft
             }
+            ComboBox {
+                model: [qsTr("Headlight"), qsTr("Shadows"), qsTr("Ambient occlusion")]
+                onCurrentIndexChanged: {
+                    renderItem.renderer.shadingMode = currentIndex
+                }
+                Layout.alignment: Qt.AlignVCenter | Qt.AlignLeft
+            }
+            ComboBox {
+                model: [qsTr("No heatmap"), qsTr("Node visits"), qsTr("Primitive tests"), qsTr("Rope hops")]
+                onCurrentIndexChanged: {
+                    renderItem.renderer.heatmap = currentIndex
+                }
+                Layout.alignment: Qt.AlignVCenter | Qt.AlignLeft
+            }
+            CheckBox {
+                text: qsTr("Point preview")
+                checked: true
+                onCheckedChanged: {
+                    renderItem.renderer.pointPreview = checked
+                }
+                Layout.alignment: Qt.AlignVCenter | Qt.AlignLeft
+            }
+            CheckBox {
+                text: qsTr("Clip box")
+                onCheckedChanged: {
+                    renderItem.clipping.boxEnabled = checked
+                }
+                Layout.alignment: Qt.AlignVCenter | Qt.AlignLeft
+            }
             Item {
                 Layout.fillWidth: true
             }
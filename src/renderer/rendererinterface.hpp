@@ -13,10 +13,48 @@ class RendererInterface
     Q_PROPERTY(bool autoRefresh MEMBER autoRefresh NOTIFY autoRefreshChanged)
     Q_PROPERTY(float dt MEMBER dt NOTIFY dtChanged)
 
+    Q_PROPERTY(ShadingMode shadingMode MEMBER shadingMode NOTIFY shadingModeChanged)
+    Q_PROPERTY(QVector3D lightDirection MEMBER lightDirection NOTIFY lightDirectionChanged)
+    Q_PROPERTY(float occlusionRadius MEMBER occlusionRadius NOTIFY occlusionRadiusChanged)
+    Q_PROPERTY(int occlusionSamples MEMBER occlusionSamples NOTIFY occlusionSamplesChanged)
+
+    Q_PROPERTY(Heatmap heatmap MEMBER heatmap NOTIFY heatmapChanged)
+    Q_PROPERTY(float heatmapScale MEMBER heatmapScale NOTIFY heatmapScaleChanged)
+    // totals ("pixels", "nodeVisits", "primitiveTests", "ropeHops") and "histograms" (map of the same names to lists of pixel counts
+    // per power of two bins) of the last frame rendered as heatmap
+    Q_PROPERTY(QVariantMap traversalStatistics MEMBER traversalStatistics NOTIFY traversalStatisticsChanged)
+
+    // while the camera moves, subset of at most previewPointCount points is splatted instead of tracing
+    Q_PROPERTY(bool pointPreview MEMBER pointPreview NOTIFY pointPreviewChanged)
+    Q_PROPERTY(int previewPointCount MEMBER previewPointCount NOTIFY previewPointCountChanged)
+
+    // MiB, zero means unlimited
+    Q_PROPERTY(int memoryBudget MEMBER memoryBudget NOTIFY memoryBudgetChanged)
+    // bytes: "budget", "used", "peak", per category ("pinnedScene", "accelerationData", "frameBuffers", "deviceBuffers", "caches"),
+    // counts of "evictions" and "refusals", and "resolutionScale" of the frame
+    Q_PROPERTY(QVariantMap memoryUsage MEMBER memoryUsage NOTIFY memoryUsageChanged)
+
 public :
 
     using QObject::QObject;
 
+    // same as ShadingMode of the raytracer
+    enum ShadingMode {
+        HeadlightShading,
+        ShadowShading,
+        AmbientOcclusionShading
+    };
+    Q_ENUM(ShadingMode)
+
+    // same as TraversalCostHeatmap of the raytracer
+    enum Heatmap {
+        NoHeatmap,
+        NodeVisitsHeatmap,
+        PrimitiveTestsHeatmap,
+        RopeHopsHeatmap
+    };
+    Q_ENUM(Heatmap)
+
     Q_INVOKABLE
     void updateProperty(QString name, QVariant value)
     {
@@ -36,9 +74,39 @@ Q_SIGNALS :
     void autoRefreshChanged(bool autoRefresh);
     void dtChanged(float dt);
 
+    void shadingModeChanged(ShadingMode shadingMode);
+    void lightDirectionChanged(QVector3D lightDirection);
+    void occlusionRadiusChanged(float occlusionRadius);
+    void occlusionSamplesChanged(int occlusionSamples);
+
+    void heatmapChanged(Heatmap heatmap);
+    void heatmapScaleChanged(float heatmapScale);
+    void traversalStatisticsChanged(QVariantMap traversalStatistics);
+
+    void pointPreviewChanged(bool pointPreview);
+    void previewPointCountChanged(int previewPointCount);
+
+    void memoryBudgetChanged(int memoryBudget);
+    void memoryUsageChanged(QVariantMap memoryUsage);
+
 private :
 
     bool autoRefresh = false;
     float dt = 0.0f;
 
+    ShadingMode shadingMode = HeadlightShading;
+    QVector3D lightDirection = {0.3f, 0.5f, 1.0f};
+    float occlusionRadius = 1.0f;
+    int occlusionSamples = 8;
+
+    Heatmap heatmap = NoHeatmap;
+    float heatmapScale = 256.0f;
+    QVariantMap traversalStatistics;
+
+    bool pointPreview = true;
+    int previewPointCount = 1 << 21;
+
+    int memoryBudget = 0;
+    QVariantMap memoryUsage;
+
 };
@@ -3,6 +3,8 @@
 #include "framebufferrenderer.hpp"
 #include "utility.hpp"
 
+#include <utility>
+
 Q_LOGGING_CATEGORY(renderItemCategory, "renderItem")
 
 RenderItem::RenderItem(QQuickItem * const parent)
@@ -10,9 +12,36 @@ RenderItem::RenderItem(QQuickItem * const parent)
 {
     Q_CHECK_PTR(camera);
     Q_CHECK_PTR(rendererInterface);
+    Q_CHECK_PTR(clipping);
 
     connect(camera, &Camera::transformationMatrixChanged, this, &QQuickFramebufferObject::update);
+    connect(camera, &Camera::transformationMatrixChanged, this, &RenderItem::onCameraMoved);
+    connect(rendererInterface, &RendererInterface::pointPreviewChanged, this, &QQuickFramebufferObject::update);
+    connect(rendererInterface, &RendererInterface::previewPointCountChanged, this, &QQuickFramebufferObject::update);
     connect(rendererInterface, &RendererInterface::autoRefreshChanged, this, &QQuickFramebufferObject::update);
+    connect(rendererInterface, &RendererInterface::shadingModeChanged, this, &QQuickFramebufferObject::update);
+    connect(rendererInterface, &RendererInterface::lightDirectionChanged, this, &QQuickFramebufferObject::update);
+    connect(rendererInterface, &RendererInterface::occlusionRadiusChanged, this, &QQuickFramebufferObject::update);
+    connect(rendererInterface, &RendererInterface::occlusionSamplesChanged, this, &QQuickFramebufferObject::update);
+    connect(rendererInterface, &RendererInterface::heatmapChanged, this, &QQuickFramebufferObject::update);
+    connect(rendererInterface, &RendererInterface::heatmapScaleChanged, this, &QQuickFramebufferObject::update);
+    connect(rendererInterface, &RendererInterface::memoryBudgetChanged, this, &QQuickFramebufferObject::update);
+    connect(clipping, &Clipping::clipChanged, this, &QQuickFramebufferObject::update);
+    connect(this, &RenderItem::sourceChanged, this, &RenderItem::onSourceChanged);
+    connect(this, &RenderItem::sourceChanged, this, &QQuickFramebufferObject::update);
+    connect(this, &RenderItem::scansChanged, this, &QQuickFramebufferObject::update);
+    connect(this, &RenderItem::navigatingChanged, this, &QQuickFramebufferObject::update);
+
+    idleTimer.setSingleShot(true);
+    connect(&idleTimer, &QTimer::timeout, this, &RenderItem::onIdle);
+
+    connect(this, &QQuickItem::windowChanged, this, [this] (QQuickWindow * window)
+    {
+        disconnect(afterAnimatingConnection);
+        if (window) {
+            afterAnimatingConnection = connect(window, &QQuickWindow::afterAnimating, this, &RenderItem::integrateMotion);
+        }
+    });
 
     setAcceptedMouseButtons(Qt::MouseButton::LeftButton);
     //setAcceptHoverEvents(true);
@@ -23,12 +52,170 @@ auto RenderItem::createRenderer() const -> Renderer *
     const auto autoRefresh = rendererInterface->property("autoRefresh").toBool();
     const auto frameBufferRenderer = new (std::nothrow) FrameBufferRenderer{autoRefresh, source};
     Q_CHECK_PTR(frameBufferRenderer);
-    connect(rendererInterface, &RendererInterface::autoRefreshChanged, this, &RenderItem::update);
-    connect(camera, &Camera::transformationMatrixChanged, this, &RenderItem::update);
-    connect(this, &RenderItem::sourceChanged, this, &RenderItem::update);
     return frameBufferRenderer;
 }
 
+int RenderItem::pick(QVariantList points)
+{
+    RayQueryBatch rayQueryBatch{++rayQueryId, {}, {}};
+    rayQueryBatch.screenPoints.reserve(points.size());
+    const qreal w = qMax(width(), qreal(1));
+    const qreal h = qMax(height(), qreal(1));
+    for (const auto & point : qAsConst(points)) {
+        const auto p = point.toPointF();
+        rayQueryBatch.screenPoints.append({p.x() / w, 1.0 - p.y() / h});
+    }
+    rayQueryBatches.append(qMove(rayQueryBatch));
+    update();
+    return rayQueryId;
+}
+
+int RenderItem::castRays(QVariantList rays)
+{
+    RayQueryBatch rayQueryBatch{++rayQueryId, {}, {}};
+    rayQueryBatch.rays.reserve(rays.size());
+    for (const auto & ray : qAsConst(rays)) {
+        const auto map = ray.toMap();
+        const auto origin = map.value(QStringLiteral("origin")).value< QVector3D >();
+        const auto direction = map.value(QStringLiteral("direction")).value< QVector3D >();
+        const auto tmax = map.value(QStringLiteral("tmax"), qInf()).toFloat();
+        rayQueryBatch.rays.append({{origin.x(), origin.y(), origin.z()}, {direction.x(), direction.y(), direction.z()}, tmax});
+    }
+    rayQueryBatches.append(qMove(rayQueryBatch));
+    update();
+    return rayQueryId;
+}
+
+auto RenderItem::takeRayQueries() -> QVector< RayQueryBatch >
+{
+    return std::exchange(rayQueryBatches, {});
+}
+
+void RenderItem::onSourceChanged()
+{
+    QVector< ScanInstance > scanInstances;
+    if (isSceneManifest(source)) {
+        readSceneManifest(source, scanInstances);
+    }
+    auto scans = toVariantList(scanInstances);
+    if (this->scans != scans) {
+        this->scans = qMove(scans);
+        Q_EMIT scansChanged(this->scans);
+    }
+}
+
+void RenderItem::onCameraMoved()
+{
+    idleTimer.start(idleDelay);
+    if (!std::exchange(navigating, true)) {
+        Q_EMIT navigatingChanged(navigating);
+    }
+}
+
+// frame is traced once the camera stops
+void RenderItem::onIdle()
+{
+    if (std::exchange(navigating, false)) {
+        Q_EMIT navigatingChanged(navigating);
+    }
+}
+
+void RenderItem::rotate(QPointF posDelta)
+{
+    const auto angularSpeed = camera->property("fieldOfView").toFloat() * lookSpeed;
+    yaw += float(posDelta.x() * angularSpeed) * camera->property("aspectRatio").toFloat(); // pan
+    if (yaw > +180.0f) {
+        yaw -= 360.0f;
+    } else if (yaw < -180.0f) {
+        yaw += 360.0f;
+    }
+    pitch -= float(posDelta.y() * angularSpeed); // tilt
+    constexpr float pitch_max = 89.9f;
+    if (pitch > +pitch_max) {
+        pitch = +pitch_max;
+    } else if (pitch < -pitch_max) {
+        pitch = -pitch_max;
+    }
+    const auto rotation = QQuaternion::fromEulerAngles(pitch, yaw, roll);
+    if (qIsNaN(rotation.lengthSquared())) {
+        qCWarning(renderItemCategory) << "rotation versor contains NaN: reset to default";
+    } else {
+        if (!camera->setProperty("rotation", rotation)) {
+            qCCritical(renderItemCategory) << "unable to set 'rotation' property of 'camera'";
+        }
+    }
+}
+
+// steps are independent of frame rate, time above the limit (e.g. after a stall) is dropped
+static constexpr qint64 motionStep = 1000000000 / 120;
+static constexpr qint64 motionMaxSteps = 12;
+// arrow keys turn the camera as the mouse moving at this speed (pixels per second)
+static constexpr float keyLookSpeed = 200.0f;
+
+void RenderItem::integrateMotion()
+{
+    if (pressedKeys.isEmpty()) {
+        motionTimer.invalidate();
+        return;
+    }
+    if (motionTimer.isValid()) {
+        motionTime += motionTimer.restart();
+    } else {
+        motionTimer.start();
+        motionTime = 0;
+    }
+    const qint64 steps = motionTime / motionStep;
+    if (steps > motionMaxSteps) {
+        motionTime = 0;
+    } else {
+        motionTime -= steps * motionStep;
+    }
+    if (steps > 0) {
+        // camera reports change of transformation matrix once per frame
+        CameraUpdate cameraUpdate{camera};
+        for (qint64 step = 0; step < qMin(steps, motionMaxSteps); ++step) {
+            stepMotion(motionStep * 1E-9f);
+        }
+    }
+    // keep frames coming while keys are held
+    if (window()) {
+        window()->update();
+    }
+}
+
+void RenderItem::stepMotion(float dt)
+{
+    QPointF look;
+    QVector3D direction; // in camera space, looking along -Z
+    for (const auto key : qAsConst(pressedKeys)) {
+        switch (key) {
+        case Qt::Key_W : direction.setZ(direction.z() - 1.0f); break;
+        case Qt::Key_S : direction.setZ(direction.z() + 1.0f); break;
+        case Qt::Key_A : direction.setX(direction.x() - 1.0f); break;
+        case Qt::Key_D : direction.setX(direction.x() + 1.0f); break;
+        case Qt::Key_PageUp : direction.setY(direction.y() + 1.0f); break;
+        case Qt::Key_PageDown : direction.setY(direction.y() - 1.0f); break;
+        case Qt::Key_Left : look.rx() -= 1.0; break;
+        case Qt::Key_Right : look.rx() += 1.0; break;
+        case Qt::Key_Up : look.ry() -= 1.0; break;
+        case Qt::Key_Down : look.ry() += 1.0; break;
+        default : break;
+        }
+    }
+    if (!look.isNull()) {
+        rotate(look * qreal(keyLookSpeed * dt));
+    }
+    if (!direction.isNull()) {
+        const float boost = pressedKeys.contains(Qt::Key_Space) ? 10.0f : 1.0f;
+        const auto rotation = camera->property("rotation").value< QQuaternion >();
+        // camera is placed at -position
+        const auto displacement = rotation.conjugated().rotatedVector(direction.normalized()) * (linearSpeed * boost * dt);
+        if (!camera->setProperty("position", camera->property("position").value< QVector3D >() - displacement)) {
+            qCCritical(renderItemCategory) << "unable to set 'position' property of 'camera'";
+        }
+    }
+}
+
 void RenderItem::clearControlsState()
 {
     pressedKeys.clear();
@@ -64,6 +251,9 @@ void RenderItem::onKeyEvent(QKeyEvent * event, bool pressed)
                                .arg(toString(key));
                 } else {
                     pressedKeys.insert(key);
+                    if (window()) {
+                        window()->update();
+                    }
                 }
             } else {
                 if (!pressedKeys.remove(key)) {
@@ -136,28 +326,7 @@ void RenderItem::mouseMoveEvent(QMouseEvent * event)
     if (event->buttons() & Qt::MouseButton::LeftButton) {
         const auto posDelta = QCursor::pos() - startPos;
         if (!posDelta.isNull()) {
-            const auto angularSpeed = camera->property("fieldOfView").toFloat() * lookSpeed;
-            yaw += (posDelta.x() * angularSpeed) * camera->property("aspectRatio").toFloat(); // pan
-            if (yaw > +180.0f) {
-                yaw -= 360.0f;
-            } else if (yaw < -180.0f) {
-                yaw += 360.0f;
-            }
-            pitch -= (posDelta.y() * angularSpeed); // tilt
-            constexpr float pitch_max = 89.9f;
-            if (pitch > +pitch_max) {
-                pitch = +pitch_max;
-            } else if (pitch < -pitch_max) {
-                pitch = -pitch_max;
-            }
-            const auto rotation = QQuaternion::fromEulerAngles(pitch, yaw, roll);
-            if (qIsNaN(rotation.lengthSquared())) {
-                qCWarning(renderItemCategory) << "rotation versor contains NaN: reset to default";
-            } else {
-                if (!camera->setProperty("rotation", rotation)) {
-                    qCCritical(renderItemCategory) << "unable to set 'rotation' property of 'camera'";
-                }
-            }
+            rotate(posDelta);
             //qDebug() << camera->property("rotation").value< QQuaternion >().toEulerAngles();
         }
         QCursor::setPos(startPos);
@@ -1,10 +1,14 @@
 #pragma once
 
 #include "camera.hpp"
+#include "clipping.hpp"
 #include "rendererinterface.hpp"
+#include "scenemanifest.hpp"
 
 #include <QtQuick>
 
+#include "rt.cuh"
+
 Q_DECLARE_LOGGING_CATEGORY(renderItemCategory)
 
 class RenderItem
@@ -15,32 +19,79 @@ class RenderItem
 
     Q_PROPERTY(Camera * camera MEMBER camera CONSTANT)
     Q_PROPERTY(RendererInterface * renderer MEMBER rendererInterface CONSTANT)
+    Q_PROPERTY(Clipping * clipping MEMBER clipping CONSTANT)
 
+    // degrees per pixel of mouse movement per degree of field of view
     Q_PROPERTY(float lookSpeed MEMBER lookSpeed NOTIFY lookSpeedChanged)
+    // scene units per second of WASD/PageUp/PageDown movement
     Q_PROPERTY(float linearSpeed MEMBER linearSpeed NOTIFY linearSpeedChanged)
 
+    // scene file or manifest of scans (*.json)
     Q_PROPERTY(QUrl source MEMBER source NOTIFY sourceChanged)
+    // scans of the manifest as maps of "source", "position", "rotation" and "scale", they can be moved, added or removed
+    Q_PROPERTY(QVariantList scans MEMBER scans NOTIFY scansChanged)
+
+    // camera has moved during the last idleDelay milliseconds
+    Q_PROPERTY(bool navigating READ isNavigating NOTIFY navigatingChanged)
+    Q_PROPERTY(int idleDelay MEMBER idleDelay NOTIFY idleDelayChanged)
 
 public :
 
     explicit RenderItem(QQuickItem * const parent = Q_NULLPTR);
 
+    // queries are coalesced and traced along with the next frame, results are delivered by rayQueryFinished()
+    // points are in item coordinates
+    Q_INVOKABLE
+    int pick(QVariantList points);
+    // rays are maps of "origin" and "direction" (vector3d) and optional "tmax" (real), in world coordinates
+    Q_INVOKABLE
+    int castRays(QVariantList rays);
+
+    struct RayQueryBatch
+    {
+
+        int id;
+        QVector< QPointF > screenPoints; // normalized to [0; 1] from the bottom left corner
+        QVector< RayQuery > rays;
+
+    };
+
+    QVector< RayQueryBatch > takeRayQueries();
+
+    bool isNavigating() const { return navigating; }
+
 Q_SIGNALS :
 
     void lookSpeedChanged(float lookSpeed);
     void linearSpeedChanged(float linearSpeed);
 
     void sourceChanged(QUrl source);
+    void scansChanged(QVariantList scans);
+
+    void navigatingChanged(bool navigating);
+    void idleDelayChanged(int idleDelay);
+
+    // list of maps of "distance", "pointId" (-1 if nothing is hit), "instanceId" (index of the scan, -1 if scans are not used), "position", "normal", "color" and "intensity"
+    void rayQueryFinished(int id, QVariantList hits);
 
 private :
 
     Camera * const camera = new (std::nothrow) Camera{this};
     RendererInterface * const rendererInterface = new (std::nothrow) RendererInterface{this};
+    Clipping * const clipping = new (std::nothrow) Clipping{this};
 
     float lookSpeed = 5E-3f;
-    float linearSpeed = 5E-3f;
+    float linearSpeed = 1.0f;
 
     QUrl source;
+    QVariantList scans;
+
+    bool navigating = false;
+    int idleDelay = 200;
+    QTimer idleTimer;
+
+    int rayQueryId = 0;
+    QVector< RayQueryBatch > rayQueryBatches;
 
     Renderer * createRenderer() const Q_DECL_OVERRIDE;
 
@@ -52,6 +103,19 @@ private :
     float yaw = 0.0f;
     float roll = 0.0f;
 
+    // motion by pressed keys is integrated with fixed timestep before each frame
+    QMetaObject::Connection afterAnimatingConnection;
+    QElapsedTimer motionTimer;
+    qint64 motionTime = 0; // nanoseconds not yet integrated
+
+    void onSourceChanged();
+    void onCameraMoved();
+    void onIdle();
+
+    void rotate(QPointF posDelta);
+    void integrateMotion();
+    void stepMotion(float dt);
+
     void clearControlsState();
 
     void onKeyEvent(QKeyEvent * event, bool pressed);
@@ -0,0 +1,139 @@
+#include "scenefile.hpp"
+
+#include <QtGui>
+
+#include "rt.cuh"
+#include "scene.cuh"
+
+#include <utility>
+
+Q_LOGGING_CATEGORY(sceneFileCategory, "sceneFile")
+
+bool SceneFile::map()
+{
+    Q_ASSERT(!f);
+    f = file.map(0, file.size(), QFile::MapPrivateOption);
+    if (!f) {
+        qCWarning(sceneFileCategory) << QStringLiteral("unable to map file %1 to memory").arg(file.fileName());
+        return false;
+    }
+    // kernels trust offsets and links, files of unknown format are still passed through to be reported by them
+    if (!(file.size() < qint64(sizeof(SceneHeader)))) {
+        if (isSupportedScene(*reinterpret_cast< const SceneHeader * >(f)) && !isConsistentScene(f, quint64(file.size()))) {
+            qCWarning(sceneFileCategory) << QStringLiteral("scene in file %1 is malformed").arg(file.fileName());
+            if (!file.unmap(std::exchange(f, Q_NULLPTR))) {
+                qCCritical(sceneFileCategory) << QStringLiteral("unable to unmap file %1").arg(file.fileName());
+            }
+            return false;
+        }
+    }
+    // pages are faulted in here, registration would do it otherwise
+    constexpr qint64 pageSize = 4096;
+    const volatile uchar * const pages = f;
+    for (qint64 offset = 0; offset < file.size(); offset += pageSize) {
+        static_cast< void >(pages[offset]);
+    }
+    return true;
+}
+
+bool SceneFile::pin()
+{
+    if (!f || scene) {
+        return true;
+    }
+    // whole file is pinned, scene can not be rendered otherwise, so it is refused if caches can not make room for it
+    if (!pinned.tryResize(quint64(file.size()))) {
+        qCWarning(sceneFileCategory) << QStringLiteral("file %1 of %2 bytes does not fit into memory budget").arg(file.fileName()).arg(file.size());
+        return false;
+    }
+    scene = CUDA_registerBuffer(f, file.size());
+    if (!scene) {
+        pinned.resize(0);
+        return false;
+    }
+    return true;
+}
+
+bool SceneFile::unpin()
+{
+    if (!std::exchange(scene, Q_NULLPTR)) {
+        return true;
+    }
+    bool success = true;
+    if (!CUDA_unregisterBuffer(f)) {
+        qCCritical(sceneFileCategory) << QStringLiteral("unable to unregister memory mapped buffer for file %1").arg(file.fileName());
+        success = false;
+    }
+    pinned.resize(0);
+    return success;
+}
+
+bool SceneFile::unmap()
+{
+    if (!f) {
+        return true;
+    }
+    bool success = unpin();
+    if (!file.unmap(std::exchange(f, Q_NULLPTR))) {
+        qCCritical(sceneFileCategory) << QStringLiteral("unable to unmap file %1").arg(file.fileName());
+        success = false;
+    }
+    return success;
+}
+
+bool SceneFile::close()
+{
+    if (!file.isOpen()) {
+        return true;
+    }
+    // mapping should be released before the file is closed, otherwise QFile unmaps it behind our back
+    const bool success = unmap();
+    file.close();
+    qCInfo(sceneFileCategory) << QStringLiteral("file %1 is closed").arg(file.fileName());
+    return success;
+}
+
+SceneFile::~SceneFile()
+{
+    close();
+}
+
+bool SceneFile::setSource(QUrl source)
+{
+    if (this->source == source) {
+        return true;
+    }
+    return open(source) && pin();
+}
+
+bool SceneFile::open(QUrl source)
+{
+    if (this->source == source) {
+        return true;
+    }
+    this->source = source;
+    if (!close()) {
+        return false;
+    }
+    if (source.isEmpty()) {
+        return true;
+    }
+    if (!source.isValid()) {
+        qCWarning(sceneFileCategory) << QStringLiteral("URL %1 is invalid").arg(source.toString());
+        return false;
+    }
+    if (!source.isLocalFile()) {
+        qCWarning(sceneFileCategory) << QStringLiteral("URL %1 is not local file").arg(source.toString());
+        return false;
+    }
+    file.setFileName(source.toLocalFile());
+    if (!file.open(QFile::ReadOnly)) {
+        qCWarning(sceneFileCategory) << QStringLiteral("unable to open file %1 to read").arg(file.fileName());
+        return false;
+    }
+    if (!map()) {
+        return false;
+    }
+    qCInfo(sceneFileCategory) << QStringLiteral("file %1 is open").arg(file.fileName());
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "memorybudget.hpp"
+
+#include <QtCore>
+
+Q_DECLARE_LOGGING_CATEGORY(sceneFileCategory)
+
+// scene file mapped to memory and registered for access from the device
+// opening (mapping, validation and prefetch) and registration are separable: the former does not touch the device nor the memory budget,
+// so it can be done on any thread, while the latter is done on the thread which renders
+class SceneFile
+{
+
+    QUrl source;
+    QFile file;
+    uchar * f = Q_NULLPTR;
+    void * scene = Q_NULLPTR;
+    MemoryReservation pinned{MemoryBudget::PinnedScene};
+
+    bool map();
+    bool unmap();
+    bool close();
+
+public :
+
+    SceneFile() = default;
+    SceneFile(const SceneFile &) = delete;
+    SceneFile & operator = (const SceneFile &) = delete;
+    ~SceneFile();
+
+    QUrl getSource() const { return source; }
+    // open() followed by pin()
+    bool setSource(QUrl source);
+
+    // maps the file and reads it through, so that registration does not wait for the disk
+    bool open(QUrl source);
+    // registers mapped file for access from the device, refused if it does not fit into memory budget
+    bool pin();
+    // returns registered memory to the budget, the file stays mapped
+    bool unpin();
+
+    const uchar * data() const { return f; }
+    qint64 size() const { return f ? file.size() : 0; }
+
+    void * devicePointer() const { return scene; }
+
+};
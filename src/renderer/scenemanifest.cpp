@@ -0,0 +1,101 @@
+#include "scenemanifest.hpp"
+
+Q_LOGGING_CATEGORY(sceneManifestCategory, "sceneManifest")
+
+QMatrix4x4 ScanInstance::transformationMatrix() const
+{
+    QMatrix4x4 matrix;
+    matrix.translate(position);
+    matrix.rotate(QQuaternion::fromEulerAngles(rotation));
+    matrix.scale(scale);
+    return matrix;
+}
+
+bool isSceneManifest(const QUrl & source)
+{
+    return source.path().endsWith(QStringLiteral(".json"), Qt::CaseInsensitive);
+}
+
+static QVector3D toVector3D(const QVariant & value, const QVector3D & defaultValue)
+{
+    if (!value.isValid()) {
+        return defaultValue;
+    }
+    if (value.userType() == qMetaTypeId< QVector3D >()) {
+        return value.value< QVector3D >();
+    }
+    const auto list = value.toList();
+    if (list.size() != 3) {
+        qCWarning(sceneManifestCategory) << QStringLiteral("vector of 3 numbers is expected");
+        return defaultValue;
+    }
+    return {list.at(0).toFloat(), list.at(1).toFloat(), list.at(2).toFloat()};
+}
+
+static ScanInstance toScanInstance(const QVariantMap & scan)
+{
+    ScanInstance scanInstance;
+    scanInstance.source = scan.value(QStringLiteral("source")).toUrl();
+    scanInstance.position = toVector3D(scan.value(QStringLiteral("position")), {});
+    scanInstance.rotation = toVector3D(scan.value(QStringLiteral("rotation")), {});
+    scanInstance.scale = scan.value(QStringLiteral("scale"), 1.0f).toFloat();
+    if (!(scanInstance.scale > 0.0f)) {
+        qCWarning(sceneManifestCategory) << QStringLiteral("scale %1 of scan %2 is not positive").arg(scanInstance.scale).arg(scanInstance.source.toString());
+        scanInstance.scale = 1.0f;
+    }
+    return scanInstance;
+}
+
+bool readSceneManifest(const QUrl & source, QVector< ScanInstance > & scans)
+{
+    scans.clear();
+    if (!source.isLocalFile()) {
+        qCWarning(sceneManifestCategory) << QStringLiteral("URL %1 is not local file").arg(source.toString());
+        return false;
+    }
+    QFile file{source.toLocalFile()};
+    if (!file.open(QFile::ReadOnly)) {
+        qCWarning(sceneManifestCategory) << QStringLiteral("unable to open file %1 to read").arg(file.fileName());
+        return false;
+    }
+    QJsonParseError error;
+    const auto manifest = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError) {
+        qCWarning(sceneManifestCategory) << QStringLiteral("manifest %1 is malformed: %2").arg(file.fileName(), error.errorString());
+        return false;
+    }
+    const auto scanList = manifest.object().value(QStringLiteral("scans")).toArray();
+    scans.reserve(scanList.size());
+    for (const auto & scan : scanList) {
+        auto scanInstance = toScanInstance(scan.toObject().toVariantMap());
+        scanInstance.source = source.resolved(QUrl{scan.toObject().value(QStringLiteral("source")).toString()});
+        scans.append(qMove(scanInstance));
+    }
+    qCInfo(sceneManifestCategory) << QStringLiteral("manifest %1 lists %2 scans").arg(file.fileName()).arg(scans.size());
+    return true;
+}
+
+QVariantList toVariantList(const QVector< ScanInstance > & scans)
+{
+    QVariantList scanList;
+    scanList.reserve(scans.size());
+    for (const auto & scan : scans) {
+        QVariantMap map;
+        map.insert(QStringLiteral("source"), scan.source);
+        map.insert(QStringLiteral("position"), scan.position);
+        map.insert(QStringLiteral("rotation"), scan.rotation);
+        map.insert(QStringLiteral("scale"), scan.scale);
+        scanList.append(map);
+    }
+    return scanList;
+}
+
+QVector< ScanInstance > toScanInstances(const QVariantList & scans)
+{
+    QVector< ScanInstance > scanInstances;
+    scanInstances.reserve(scans.size());
+    for (const auto & scan : scans) {
+        scanInstances.append(toScanInstance(scan.toMap()));
+    }
+    return scanInstances;
+}
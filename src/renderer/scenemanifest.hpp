@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QtGui>
+
+Q_DECLARE_LOGGING_CATEGORY(sceneManifestCategory)
+
+// scan placed into the world: scene file transformed by uniform scale, then rotation, then translation
+struct ScanInstance
+{
+
+    QUrl source;
+    QVector3D position;
+    QVector3D rotation; // Euler angles in degrees: pitch (x), yaw (y), roll (z)
+    float scale = 1.0f;
+
+    QMatrix4x4 transformationMatrix() const;
+
+    bool operator == (const ScanInstance & other) const
+    {
+        return (source == other.source) && (position == other.position) && (rotation == other.rotation) && (scale == other.scale);
+    }
+
+};
+
+// manifest is JSON file {"scans": [{"source": "a.rbin", "position": [x, y, z], "rotation": [pitch, yaw, roll], "scale": s}, ...]}
+// sources are relative to the manifest, transformation is optional
+bool isSceneManifest(const QUrl & source);
+bool readSceneManifest(const QUrl & source, QVector< ScanInstance > & scans);
+
+// maps of "source" (url), "position", "rotation" (vector3d or list of numbers) and "scale" (real), as exposed to QML
+QVariantList toVariantList(const QVector< ScanInstance > & scans);
+QVector< ScanInstance > toScanInstances(const QVariantList & scans);
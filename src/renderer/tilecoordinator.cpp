@@ -0,0 +1,270 @@
+#include "tilecoordinator.hpp"
+#include "frameimage.hpp"
+
+#include "utility.hpp"
+
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(tileCoordinatorCategory, "tileCoordinator")
+
+TileCoordinator::TileCoordinator(QObject * const parent)
+    : QObject{parent}
+{
+    Q_CHECK_PTR(camera);
+}
+
+TileCoordinator::~TileCoordinator()
+{
+    for (const auto & worker : workers) {
+        worker->socket->disconnect(this);
+        worker->socket->close();
+    }
+    workers.clear();
+    // workers exit as soon as connection is closed
+    for (const auto process : qAsConst(processes)) {
+        if (!process->waitForFinished()) {
+            qCWarning(tileCoordinatorCategory) << QStringLiteral("worker process %1 is not finished: kill it").arg(process->processId());
+            process->kill();
+            process->waitForFinished();
+        }
+    }
+}
+
+bool TileCoordinator::listen(QString address)
+{
+    QString host;
+    quint16 port = 0;
+    if (parseTcpAddress(address, &host, &port)) {
+        tcpServer = new (std::nothrow) QTcpServer{this};
+        Q_CHECK_PTR(tcpServer);
+        QHostAddress hostAddress{host};
+        if (host == QLatin1String("localhost")) {
+            hostAddress = QHostAddress::LocalHost;
+        }
+        if (!tcpServer->listen(hostAddress, port)) {
+            qCWarning(tileCoordinatorCategory) << QStringLiteral("unable to listen on %1: %2").arg(address, tcpServer->errorString());
+            return false;
+        }
+        connect(tcpServer, &QTcpServer::newConnection, this, [this]
+        {
+            while (const auto socket = tcpServer->nextPendingConnection()) {
+                socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+                addWorker(socket);
+            }
+        });
+    } else {
+        localServer = new (std::nothrow) QLocalServer{this};
+        Q_CHECK_PTR(localServer);
+        QLocalServer::removeServer(address);
+        if (!localServer->listen(address)) {
+            qCWarning(tileCoordinatorCategory) << QStringLiteral("unable to listen on %1: %2").arg(address, localServer->errorString());
+            return false;
+        }
+        connect(localServer, &QLocalServer::newConnection, this, [this]
+        {
+            while (const auto socket = localServer->nextPendingConnection()) {
+                addWorker(socket);
+            }
+        });
+    }
+    this->address = address;
+    qCInfo(tileCoordinatorCategory) << QStringLiteral("listening on %1").arg(address);
+    return true;
+}
+
+bool TileCoordinator::spawnWorkers(int count)
+{
+    Q_ASSERT(!address.isEmpty());
+    for (int i = 0; i < count; ++i) {
+        const auto process = new (std::nothrow) QProcess{this};
+        Q_CHECK_PTR(process);
+        process->setProcessChannelMode(QProcess::ForwardedChannels);
+        process->start(QCoreApplication::applicationFilePath(), {QStringLiteral("--worker"), address});
+        if (!process->waitForStarted()) {
+            qCWarning(tileCoordinatorCategory) << QStringLiteral("unable to start worker process: %1").arg(process->errorString());
+            return false;
+        }
+        processes.append(process);
+    }
+    return true;
+}
+
+void TileCoordinator::addWorker(QIODevice * socket)
+{
+    auto worker = std::make_unique< Worker >();
+    worker->socket = socket;
+    worker->stream.setDevice(socket);
+    worker->stream.setVersion(tileProtocolVersion);
+    const auto w = worker.get();
+    connect(socket, &QIODevice::readyRead, this, [this, w] { onReadyRead(*w); });
+    if (!connectDisconnected(socket, this, [this, socket] { removeWorker(socket); })) {
+        socket->deleteLater();
+        return;
+    }
+    workers.push_back(qMove(worker));
+    qCInfo(tileCoordinatorCategory) << QStringLiteral("worker is connected: %1 of %2").arg(workers.size()).arg(workerCount);
+    if ((frame == 0) && !(int(workers.size()) < workerCount)) {
+        renderFrame();
+    }
+}
+
+void TileCoordinator::removeWorker(QIODevice * socket)
+{
+    const auto it = std::find_if(workers.cbegin(), workers.cend(), [socket] (const auto & worker) { return worker->socket == socket; });
+    if (it == workers.cend()) {
+        return;
+    }
+    const bool busy = (*it)->busy;
+    workers.erase(it);
+    socket->deleteLater();
+    qCWarning(tileCoordinatorCategory) << QStringLiteral("worker is disconnected: %1 left").arg(workers.size());
+    if (busy) {
+        if (workers.empty()) {
+            qCWarning(tileCoordinatorCategory) << QStringLiteral("no workers left to render frame");
+            Q_EMIT finished(false);
+            return;
+        }
+        // strip of the lost worker is redistributed among the rest by starting the frame over
+        qCInfo(tileCoordinatorCategory) << QStringLiteral("frame %1 is restarted on %2 workers").arg(framesRendered + 1).arg(workers.size());
+        renderFrame();
+    }
+}
+
+void TileCoordinator::onReadyRead(Worker & worker)
+{
+    for (;;) {
+        worker.stream.startTransaction();
+        TileResult tileResult;
+        worker.stream >> tileResult;
+        if (!worker.stream.commitTransaction()) {
+            break;
+        }
+        onTileResult(worker, tileResult);
+    }
+}
+
+void TileCoordinator::onTileResult(Worker & worker, const TileResult & tileResult)
+{
+    if (tileResult.frame == worker.outstanding) {
+        worker.outstanding = 0;
+    }
+    if ((tileResult.frame != frame) || !worker.busy) {
+        // result for abandoned frame, tile of the current one can be requested now
+        if (worker.busy && (worker.outstanding == 0)) {
+            requestTile(worker);
+        }
+        return;
+    }
+    const auto & tile = worker.tile;
+    if ((tileResult.tile != tile) || (tileResult.pixels.size() != tile.width() * tile.height() * 3 * int(sizeof(float)))) {
+        qCWarning(tileCoordinatorCategory) << QStringLiteral("malformed result for tile %1").arg(toString(tile));
+        Q_EMIT finished(false);
+        return;
+    }
+    worker.busy = false;
+    const qint64 nsecs = qMax(worker.elapsedTimer.nsecsElapsed(), qint64(1));
+    const double throughput = (tile.width() * tile.height()) / (nsecs * 1E-9);
+    // moving average smooths out jitter of timings
+    worker.throughput = (worker.throughput > 0.0) ? (0.5 * worker.throughput + 0.5 * throughput) : throughput;
+    qCDebug(tileCoordinatorCategory)
+            << QStringLiteral("tile %1 is rendered in %2 ms (round trip %3 ms)")
+               .arg(toString(tile)).arg(tileResult.nsecs * 1E-6).arg(nsecs * 1E-6);
+    const int width = frameSize.width();
+    const auto src = reinterpret_cast< const float * >(tileResult.pixels.constData());
+    for (int y = 0; y < tile.height(); ++y) {
+        std::copy_n(src + y * tile.width() * 3, tile.width() * 3, pixels.data() + ((tile.y() + y) * width + tile.x()) * 3);
+    }
+    if (--pending == 0) {
+        onFrameFinished();
+    }
+}
+
+void TileCoordinator::requestTile(Worker & worker)
+{
+    Q_ASSERT(worker.busy && (worker.outstanding == 0));
+    tileRequest.tile = worker.tile;
+    worker.outstanding = tileRequest.frame;
+    worker.elapsedTimer.start();
+    worker.stream << tileRequest;
+}
+
+void TileCoordinator::renderFrame()
+{
+    Q_ASSERT(!workers.empty());
+    ++frame;
+    const int width = frameSize.width();
+    const int height = frameSize.height();
+    pixels.resize(width * height * 3);
+    if (!camera->setProperty("aspectRatio", float(qMax(1, width)) / float(qMax(1, height)))) {
+        qCCritical(tileCoordinatorCategory) << "unable to set 'aspectRatio' property of 'camera'";
+    }
+    tileRequest.frame = frame;
+    tileRequest.source = source;
+    tileRequest.transformationMatrix = camera->transformationMatrix();
+    tileRequest.frameSize = frameSize;
+    // workers, which have not rendered anything yet, are assumed to be as fast as average one
+    double known = 0.0;
+    int knownCount = 0;
+    for (const auto & worker : workers) {
+        if (worker->throughput > 0.0) {
+            known += worker->throughput;
+            ++knownCount;
+        }
+    }
+    const double average = (knownCount > 0) ? (known / knownCount) : 1.0;
+    const auto weight = [average] (const Worker & worker) { return (worker.throughput > 0.0) ? worker.throughput : average; };
+    double total = 0.0;
+    for (const auto & worker : workers) {
+        total += weight(*worker);
+    }
+    frameTimer.start();
+    pending = 0;
+    double accumulated = 0.0;
+    int top = 0;
+    for (const auto & worker : workers) {
+        accumulated += weight(*worker);
+        const int bottom = (worker == workers.back()) ? height : qRound(height * (accumulated / total));
+        worker->tile = QRect{0, top, width, bottom - top};
+        worker->busy = !worker->tile.isEmpty();
+        top = bottom;
+        if (!worker->busy) {
+            continue;
+        }
+        ++pending;
+        if (worker->outstanding == 0) {
+            requestTile(*worker);
+        } else {
+            qCDebug(tileCoordinatorCategory) << QStringLiteral("tile %1 is queued until result for frame %2 is received").arg(toString(worker->tile)).arg(worker->outstanding);
+        }
+    }
+    if (pending == 0) {
+        onFrameFinished();
+    }
+}
+
+void TileCoordinator::onFrameFinished()
+{
+    ++framesRendered;
+    qCInfo(tileCoordinatorCategory)
+            << QStringLiteral("frame %1 is rendered in %2 ms by %3 workers")
+               .arg(framesRendered).arg(frameTimer.nsecsElapsed() * 1E-6).arg(workers.size());
+    if (framesRendered < frameCount) {
+        renderFrame();
+        return;
+    }
+    Q_EMIT finished(saveFrame());
+}
+
+bool TileCoordinator::saveFrame() const
+{
+    if (output.isEmpty()) {
+        return true;
+    }
+    const QImage image = frameImage(pixels.constData(), frameSize);
+    if (!image.save(output)) {
+        qCWarning(tileCoordinatorCategory) << QStringLiteral("unable to save frame to %1").arg(output);
+        return false;
+    }
+    qCInfo(tileCoordinatorCategory) << QStringLiteral("frame is saved to %1").arg(output);
+    return true;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "camera.hpp"
+#include "tileprotocol.hpp"
+
+#include <QtCore>
+
+#include <memory>
+#include <vector>
+
+Q_DECLARE_LOGGING_CATEGORY(tileCoordinatorCategory)
+
+// sort-first rendering: every frame is split into horizontal strips, one per connected worker,
+// strip heights are proportional to throughput of the workers measured on previous frames
+class TileCoordinator
+        : public QObject
+{
+
+    Q_OBJECT
+
+    Q_PROPERTY(Camera * camera MEMBER camera CONSTANT)
+
+    Q_PROPERTY(QUrl source MEMBER source NOTIFY sourceChanged)
+    Q_PROPERTY(QSize frameSize MEMBER frameSize NOTIFY frameSizeChanged)
+    Q_PROPERTY(int frameCount MEMBER frameCount NOTIFY frameCountChanged)
+    Q_PROPERTY(int workerCount MEMBER workerCount NOTIFY workerCountChanged)
+    Q_PROPERTY(QString output MEMBER output NOTIFY outputChanged)
+
+public :
+
+    explicit
+    TileCoordinator(QObject * const parent = Q_NULLPTR);
+    ~TileCoordinator() Q_DECL_OVERRIDE;
+
+    bool listen(QString address);
+    bool spawnWorkers(int count);
+
+Q_SIGNALS :
+
+    void sourceChanged(QUrl source);
+    void frameSizeChanged(QSize frameSize);
+    void frameCountChanged(int frameCount);
+    void workerCountChanged(int workerCount);
+    void outputChanged(QString output);
+
+    void finished(bool success);
+
+private :
+
+    struct Worker
+    {
+
+        QIODevice * socket = Q_NULLPTR;
+        QDataStream stream;
+        double throughput = 0.0; // pixels per second
+        QRect tile;
+        bool busy = false;
+        // frame of the request not answered yet, zero if none: request of the next frame is queued until the answer,
+        // otherwise round trip would include rendering of the abandoned tile
+        quint64 outstanding = 0;
+        QElapsedTimer elapsedTimer; // round trip, network included
+
+    };
+
+    Camera * const camera = new (std::nothrow) Camera{this};
+
+    QUrl source;
+    QSize frameSize = {1024, 768};
+    int frameCount = 1;
+    int workerCount = 1; // workers to wait for before the first frame
+    QString output;
+
+    QString address;
+    QLocalServer * localServer = Q_NULLPTR;
+    QTcpServer * tcpServer = Q_NULLPTR;
+    QList< QProcess * > processes;
+
+    std::vector< std::unique_ptr< Worker > > workers;
+
+    quint64 frame = 0;
+    TileRequest tileRequest; // of the current frame
+    int framesRendered = 0;
+    int pending = 0;
+    QElapsedTimer frameTimer;
+    QVector< float > pixels;
+
+    void addWorker(QIODevice * socket);
+    void removeWorker(QIODevice * socket);
+    void onReadyRead(Worker & worker);
+    void onTileResult(Worker & worker, const TileResult & tileResult);
+
+    void requestTile(Worker & worker);
+    void renderFrame();
+    void onFrameFinished();
+    bool saveFrame() const;
+
+};
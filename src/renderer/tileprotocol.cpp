@@ -0,0 +1,69 @@
+#include "tileprotocol.hpp"
+
+Q_LOGGING_CATEGORY(tileProtocolCategory, "tileProtocol")
+
+QDataStream & operator << (QDataStream & out, const TileRequest & tileRequest)
+{
+    return out << tileRequest.frame
+               << tileRequest.source
+               << tileRequest.transformationMatrix
+               << tileRequest.frameSize
+               << tileRequest.tile;
+}
+
+QDataStream & operator >> (QDataStream & in, TileRequest & tileRequest)
+{
+    return in >> tileRequest.frame
+              >> tileRequest.source
+              >> tileRequest.transformationMatrix
+              >> tileRequest.frameSize
+              >> tileRequest.tile;
+}
+
+QDataStream & operator << (QDataStream & out, const TileResult & tileResult)
+{
+    return out << tileResult.frame
+               << tileResult.tile
+               << tileResult.nsecs
+               << tileResult.pixels;
+}
+
+QDataStream & operator >> (QDataStream & in, TileResult & tileResult)
+{
+    return in >> tileResult.frame
+              >> tileResult.tile
+              >> tileResult.nsecs
+              >> tileResult.pixels;
+}
+
+bool parseTcpAddress(const QString & address, QString * host, quint16 * port)
+{
+    const int colon = address.lastIndexOf(QLatin1Char(':'));
+    if (colon < 1) {
+        return false;
+    }
+    bool ok = false;
+    const auto p = address.midRef(colon + 1).toUShort(&ok);
+    if (!ok || (p == 0)) {
+        return false;
+    }
+    if (host) {
+        *host = address.left(colon);
+    }
+    if (port) {
+        *port = p;
+    }
+    return true;
+}
+
+bool connectDisconnected(QIODevice * socket, const QObject * receiver, std::function< void () > slot)
+{
+    if (const auto localSocket = qobject_cast< QLocalSocket * >(socket)) {
+        return QObject::connect(localSocket, &QLocalSocket::disconnected, receiver, qMove(slot));
+    }
+    if (const auto tcpSocket = qobject_cast< QTcpSocket * >(socket)) {
+        return QObject::connect(tcpSocket, &QTcpSocket::disconnected, receiver, qMove(slot));
+    }
+    qCWarning(tileProtocolCategory) << QStringLiteral("unsupported socket type %1").arg(QString::fromLatin1(socket->metaObject()->className()));
+    return false;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QtGui>
+#include <QtNetwork>
+
+Q_DECLARE_LOGGING_CATEGORY(tileProtocolCategory)
+
+// coordinator -> worker: render a tile of the frame
+struct TileRequest
+{
+
+    quint64 frame = 0;
+    QUrl source;
+    QMatrix4x4 transformationMatrix;
+    QSize frameSize;
+    QRect tile;
+
+};
+
+// worker -> coordinator: RGB float pixels of the tile and time spent to render it
+struct TileResult
+{
+
+    quint64 frame = 0;
+    QRect tile;
+    qint64 nsecs = 0;
+    QByteArray pixels;
+
+};
+
+QDataStream & operator << (QDataStream & out, const TileRequest & tileRequest);
+QDataStream & operator >> (QDataStream & in, TileRequest & tileRequest);
+
+QDataStream & operator << (QDataStream & out, const TileResult & tileResult);
+QDataStream & operator >> (QDataStream & in, TileResult & tileResult);
+
+constexpr auto tileProtocolVersion = QDataStream::Qt_5_9;
+
+// "host:port" denotes TCP endpoint, anything else is a name of local socket
+bool parseTcpAddress(const QString & address, QString * host = Q_NULLPTR, quint16 * port = Q_NULLPTR);
+
+// both QLocalSocket and QTcpSocket are accepted
+bool connectDisconnected(QIODevice * socket, const QObject * receiver, std::function< void () > slot);
@@ -0,0 +1,87 @@
+#include "tileworker.hpp"
+#include "camera.hpp"
+
+#include "utility.hpp"
+
+#include "rt.cuh"
+
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(tileWorkerCategory, "tileWorker")
+
+TileWorker::TileWorker(QObject * const parent)
+    : QObject{parent}
+{
+    stream.setVersion(tileProtocolVersion);
+}
+
+bool TileWorker::connectToCoordinator(QString address)
+{
+    Q_ASSERT(!socket);
+    QString host;
+    quint16 port = 0;
+    if (parseTcpAddress(address, &host, &port)) {
+        const auto tcpSocket = new (std::nothrow) QTcpSocket{this};
+        Q_CHECK_PTR(tcpSocket);
+        tcpSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        tcpSocket->connectToHost(host, port);
+        if (!tcpSocket->waitForConnected()) {
+            qCWarning(tileWorkerCategory) << QStringLiteral("unable to connect to %1: %2").arg(address, tcpSocket->errorString());
+            return false;
+        }
+        socket = tcpSocket;
+    } else {
+        const auto localSocket = new (std::nothrow) QLocalSocket{this};
+        Q_CHECK_PTR(localSocket);
+        localSocket->connectToServer(address);
+        if (!localSocket->waitForConnected()) {
+            qCWarning(tileWorkerCategory) << QStringLiteral("unable to connect to %1: %2").arg(address, localSocket->errorString());
+            return false;
+        }
+        socket = localSocket;
+    }
+    stream.setDevice(socket);
+    connect(socket, &QIODevice::readyRead, this, &TileWorker::onReadyRead);
+    if (!connectDisconnected(socket, this, [this] { Q_EMIT finished(); })) {
+        return false;
+    }
+    qCInfo(tileWorkerCategory) << QStringLiteral("connected to coordinator %1").arg(address);
+    return true;
+}
+
+void TileWorker::onReadyRead()
+{
+    for (;;) {
+        stream.startTransaction();
+        TileRequest tileRequest;
+        stream >> tileRequest;
+        if (!stream.commitTransaction()) {
+            break;
+        }
+        process(tileRequest);
+    }
+}
+
+void TileWorker::process(const TileRequest & tileRequest)
+{
+    if (!sceneFile.setSource(tileRequest.source)) {
+        qCWarning(tileWorkerCategory) << QStringLiteral("unable to open scene %1").arg(tileRequest.source.toString());
+    }
+    QElapsedTimer elapsedTimer;
+    elapsedTimer.start();
+    const auto & tile = tileRequest.tile;
+    TileResult tileResult;
+    tileResult.frame = tileRequest.frame;
+    tileResult.tile = tile;
+    tileResult.pixels.resize(tile.width() * tile.height() * 3 * int(sizeof(float)));
+    RenderParameters parameters = {};
+    parameters.scene = sceneFile.devicePointer();
+    parameters.shading = {HeadlightShading, {0.0f, 0.0f, 1.0f}, 0.0f, 0};
+    const auto inverseTransformationMatrix = windowToWorldMatrix(tileRequest.transformationMatrix, tileRequest.frameSize);
+    std::copy_n(inverseTransformationMatrix.constData(), 16, parameters.inverseTransformationMatrix);
+    if (!CUDA_renderToHost(tileResult.pixels.data(), parameters, tile.x(), tile.y(), tile.width(), tile.height())) {
+        qCCritical(tileWorkerCategory) << QStringLiteral("unable to render tile %1").arg(toString(tile));
+    }
+    tileResult.nsecs = elapsedTimer.nsecsElapsed();
+    stream << tileResult;
+}
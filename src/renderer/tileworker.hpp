@@ -0,0 +1,38 @@
+#pragma once
+
+#include "scenefile.hpp"
+#include "tileprotocol.hpp"
+
+#include <QtCore>
+
+Q_DECLARE_LOGGING_CATEGORY(tileWorkerCategory)
+
+// headless engine process: renders tiles requested by coordinator and sends them back
+class TileWorker
+        : public QObject
+{
+
+    Q_OBJECT
+
+public :
+
+    explicit
+    TileWorker(QObject * const parent = Q_NULLPTR);
+
+    bool connectToCoordinator(QString address);
+
+Q_SIGNALS :
+
+    void finished();
+
+private :
+
+    QIODevice * socket = Q_NULLPTR;
+    QDataStream stream;
+
+    SceneFile sceneFile;
+
+    void onReadyRead();
+    void process(const TileRequest & tileRequest);
+
+};
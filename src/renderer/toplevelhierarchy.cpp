@@ -0,0 +1,202 @@
+#include "toplevelhierarchy.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+Q_LOGGING_CATEGORY(topLevelHierarchyCategory, "topLevelHierarchy")
+
+static SceneBox emptyBox()
+{
+    constexpr auto infinity = std::numeric_limits< float >::infinity();
+    return {{infinity, infinity, infinity}, {-infinity, -infinity, -infinity}};
+}
+
+static void unite(SceneBox & box, const SceneBox & other)
+{
+    for (int i = 0; i < 3; ++i) {
+        box.min[i] = std::min(box.min[i], other.min[i]);
+        box.max[i] = std::max(box.max[i], other.max[i]);
+    }
+}
+
+// box enclosing transformed corners of the bounds of the root
+static SceneBox worldBox(const TopLevelHierarchy::Scan & scan)
+{
+    const SceneBox & box = sceneNodes(scan.scene)[0].box;
+    SceneBox worldBox = emptyBox();
+    for (int corner = 0; corner < 8; ++corner) {
+        const QVector3D p = scan.transformationMatrix.map(QVector3D{(corner & 1) ? box.max[0] : box.min[0], (corner & 2) ? box.max[1] : box.min[1], (corner & 4) ? box.max[2] : box.min[2]});
+        unite(worldBox, {{p.x(), p.y(), p.z()}, {p.x(), p.y(), p.z()}});
+    }
+    return worldBox;
+}
+
+static SceneInstance makeInstance(const TopLevelHierarchy::Scan & scan)
+{
+    const auto deviceScene = static_cast< const uchar * >(scan.deviceScene);
+    SceneInstance instance = {};
+    instance.nodes = reinterpret_cast< const SceneNode * >(deviceScene + scan.scene->nodeOffset);
+    instance.points = reinterpret_cast< const ScenePoint * >(deviceScene + scan.scene->pointOffset);
+    instance.nodeCount = std::int32_t(scan.scene->nodeCount);
+    instance.radius = scan.scene->pointRadius;
+    instance.scale = scan.scale;
+    const QMatrix4x4 inverse = scan.transformationMatrix.inverted();
+    for (int row = 0; row < 3; ++row) {
+        for (int column = 0; column < 4; ++column) {
+            instance.objectToWorld[row * 4 + column] = scan.transformationMatrix(row, column);
+            instance.worldToObject[row * 4 + column] = inverse(row, column);
+        }
+    }
+    return instance;
+}
+
+TopLevelHierarchy::~TopLevelHierarchy()
+{
+    release();
+}
+
+void TopLevelHierarchy::release()
+{
+    if (deviceNodes) {
+        if (!CUDA_unregisterBuffer(nodes.data())) {
+            qCCritical(topLevelHierarchyCategory) << "unable to unregister buffer of top level nodes";
+        }
+        deviceNodes = Q_NULLPTR;
+    }
+    if (deviceInstances) {
+        if (!CUDA_unregisterBuffer(instances.data())) {
+            qCCritical(topLevelHierarchyCategory) << "unable to unregister buffer of instances";
+        }
+        deviceInstances = Q_NULLPTR;
+    }
+    std::vector< SceneNode >{}.swap(nodes);
+    std::vector< SceneInstance >{}.swap(instances);
+    std::vector< int >{}.swap(instanceIds);
+    std::vector< const SceneHeader * >{}.swap(scenes);
+    reservation.resize(0);
+}
+
+void TopLevelHierarchy::update(const QVector< Scan > & scans)
+{
+    std::vector< SceneBox > boxes;
+    boxes.reserve(std::size_t(scans.size()));
+    for (const auto & scan : scans) {
+        Q_ASSERT(scan.scene && (scan.scene->nodeCount > 0));
+        boxes.push_back(worldBox(scan));
+    }
+    bool sameScenes = !isEmpty() && (scenes.size() == std::size_t(scans.size()));
+    for (std::size_t i = 0; sameScenes && (i < scenes.size()); ++i) {
+        sameScenes = (scenes[i] == scans.at(instanceIds[i]).scene);
+    }
+    if (sameScenes) {
+        for (std::size_t i = 0; i < instances.size(); ++i) {
+            instances[i] = makeInstance(scans.at(instanceIds[i]));
+        }
+        refit(boxes);
+        return;
+    }
+    release();
+    if (scans.isEmpty()) {
+        return;
+    }
+    const std::size_t nodeCount = 2 * std::size_t(scans.size()) - 1;
+    if (!reservation.tryResize(sizeof(SceneNode) * nodeCount + sizeof(SceneInstance) * std::size_t(scans.size()))) {
+        qCWarning(topLevelHierarchyCategory) << "top level hierarchy does not fit into memory budget, scans are not rendered";
+        return;
+    }
+    instanceIds.resize(std::size_t(scans.size()));
+    std::iota(instanceIds.begin(), instanceIds.end(), 0);
+    nodes.resize(nodeCount);
+    rebuild(boxes);
+    instances.reserve(instanceIds.size());
+    scenes.reserve(instanceIds.size());
+    for (const int instanceId : instanceIds) {
+        instances.push_back(makeInstance(scans.at(instanceId)));
+        scenes.push_back(scans.at(instanceId).scene);
+    }
+    deviceNodes = CUDA_registerBuffer(nodes.data(), sizeof(SceneNode) * nodes.size());
+    deviceInstances = CUDA_registerBuffer(instances.data(), sizeof(SceneInstance) * instances.size());
+    if (!deviceNodes || !deviceInstances) {
+        qCWarning(topLevelHierarchyCategory) << "unable to register buffers of top level hierarchy, scans are not rendered";
+        release();
+        return;
+    }
+    qCDebug(topLevelHierarchyCategory) << QStringLiteral("top level hierarchy is built over %1 scans").arg(scans.size());
+}
+
+// one instance per leaf, instances are split at the median of the centres of their boxes along the longest axis of the centres
+// it is balanced, so depth is logarithmic
+void TopLevelHierarchy::rebuild(const std::vector< SceneBox > & boxes)
+{
+    const auto centre = [&boxes] (int instanceId, int axis)
+    {
+        const SceneBox & box = boxes[std::size_t(instanceId)];
+        return box.min[axis] + box.max[axis];
+    };
+    struct Range
+    {
+        int node, first, last;
+    };
+    std::vector< Range > ranges = {{0, 0, int(instanceIds.size())}};
+    while (!ranges.empty()) {
+        const Range range = ranges.back();
+        ranges.pop_back();
+        SceneNode & node = nodes[std::size_t(range.node)];
+        node.box = emptyBox();
+        for (int i = range.first; i < range.last; ++i) {
+            unite(node.box, boxes[std::size_t(instanceIds[std::size_t(i)])]);
+        }
+        if (range.last - range.first == 1) {
+            node.right = -1;
+            node.first = std::uint32_t(range.first);
+            node.count = 1;
+            continue;
+        }
+        SceneBox centres = emptyBox();
+        for (int i = range.first; i < range.last; ++i) {
+            const int instanceId = instanceIds[std::size_t(i)];
+            unite(centres, {{centre(instanceId, 0), centre(instanceId, 1), centre(instanceId, 2)}, {centre(instanceId, 0), centre(instanceId, 1), centre(instanceId, 2)}});
+        }
+        int axis = 0;
+        for (int i = 1; i < 3; ++i) {
+            if (centres.max[axis] - centres.min[axis] < centres.max[i] - centres.min[i]) {
+                axis = i;
+            }
+        }
+        const int middle = (range.first + range.last) / 2;
+        std::nth_element(instanceIds.begin() + range.first, instanceIds.begin() + middle, instanceIds.begin() + range.last, [&centre, axis] (int l, int r)
+        {
+            return centre(l, axis) < centre(r, axis);
+        });
+        // subtree over n instances has 2n - 1 nodes, left one immediately follows the node
+        node.right = range.node + 2 * (middle - range.first);
+        node.first = 0;
+        node.count = 0;
+        ranges.push_back({range.node + 1, range.first, middle});
+        ranges.push_back({node.right, middle, range.last});
+    }
+    // ropes: of left child is the right one, of right child is the rope of the parent
+    nodes[0].rope = -1;
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        if (!(nodes[i].right < 0)) {
+            nodes[i + 1].rope = nodes[i].right;
+            nodes[std::size_t(nodes[i].right)].rope = nodes[i].rope;
+        }
+    }
+}
+
+// children follow their parent, so bounds are updated bottom-up in the reverse order
+void TopLevelHierarchy::refit(const std::vector< SceneBox > & boxes)
+{
+    for (std::size_t i = nodes.size(); i > 0; --i) {
+        SceneNode & node = nodes[i - 1];
+        if (node.right < 0) {
+            node.box = boxes[std::size_t(instanceIds[node.first])];
+        } else {
+            node.box = nodes[i].box;
+            unite(node.box, nodes[std::size_t(node.right)].box);
+        }
+    }
+    qCDebug(topLevelHierarchyCategory) << QStringLiteral("top level hierarchy is refit over %1 scans").arg(instanceIds.size());
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "memorybudget.hpp"
+
+#include <QtGui>
+
+#include "rt.cuh"
+#include "scene.cuh"
+
+#include <vector>
+
+Q_DECLARE_LOGGING_CATEGORY(topLevelHierarchyCategory)
+
+// top level of two-level hierarchy: bounding volume hierarchy over the world bounds of scans, each of which refers to the hierarchy of its scene
+// scenes are shared by their instances; if only transformations of the scans change, then the top level is refit, otherwise it is rebuilt
+// nodes and instances are registered for access from the device and rewritten in place
+class TopLevelHierarchy
+{
+
+    std::vector< SceneNode > nodes;
+    std::vector< SceneInstance > instances; // in the order of the leaves
+    std::vector< int > instanceIds; // index of the scan of the instance
+    std::vector< const SceneHeader * > scenes;
+    void * deviceNodes = Q_NULLPTR;
+    void * deviceInstances = Q_NULLPTR;
+    MemoryReservation reservation{MemoryBudget::AccelerationData};
+
+    void release();
+    void rebuild(const std::vector< SceneBox > & boxes);
+    void refit(const std::vector< SceneBox > & boxes);
+
+public :
+
+    // scan placed into the world, its scene is host memory of supported and consistent non-empty scene registered for the device
+    struct Scan
+    {
+
+        const SceneHeader * scene;
+        const void * deviceScene;
+        QMatrix4x4 transformationMatrix;
+        float scale;
+
+    };
+
+    TopLevelHierarchy() = default;
+    TopLevelHierarchy(const TopLevelHierarchy &) = delete;
+    TopLevelHierarchy & operator = (const TopLevelHierarchy &) = delete;
+    ~TopLevelHierarchy();
+
+    void update(const QVector< Scan > & scans);
+
+    bool isEmpty() const { return !deviceNodes; }
+
+    // scan of the instance hit by the ray, -1 for -1
+    int instanceId(int instance) const { return (instance < 0) ? -1 : instanceIds.at(std::size_t(instance)); }
+
+    // null if empty
+    void * nodesDevicePointer() const { return deviceNodes; }
+    void * instancesDevicePointer() const { return deviceInstances; }
+
+};
@@ -0,0 +1,311 @@
+#include "pointcloud.hpp"
+
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <unordered_map>
+#include <utility>
+
+#include <cmath>
+#include <cstdint>
+
+Q_LOGGING_CATEGORY(pointCloudCategory, "pointCloud")
+
+namespace
+{
+
+// function(first, last) is called for blocks of [0; count) on the global thread pool, several blocks per thread balance the load
+template< typename Function >
+void parallelFor(std::size_t count, const Function & function)
+{
+    const std::size_t blockCount = std::min(count, std::size_t(std::max(QThread::idealThreadCount(), 1)) * 8);
+    std::vector< std::pair< std::size_t, std::size_t > > blocks;
+    blocks.reserve(blockCount);
+    for (std::size_t block = 0; block < blockCount; ++block) {
+        blocks.emplace_back(count * block / blockCount, count * (block + 1) / blockCount);
+    }
+    QtConcurrent::blockingMap(blocks, [&function] (const std::pair< std::size_t, std::size_t > & block)
+    {
+        function(block.first, block.second);
+    });
+}
+
+// points grouped by cubic cells; cells are distributed over buckets by hash of the cell, so that buckets are sorted and indexed in parallel
+// coordinates of cells wrap around at 2^21 cells per axis, cells which alias are merged, so queries should check distances
+class SpatialHashGrid
+{
+
+    static constexpr int cellBits = 21;
+    static constexpr std::int64_t cellMask = (std::int64_t(1) << cellBits) - 1;
+
+    const float cellSize;
+    std::vector< std::uint32_t > bucketOffsets;
+    std::vector< std::unordered_map< std::uint64_t, std::pair< std::uint32_t, std::uint32_t > > > buckets; // cell -> range of indices
+
+    std::size_t bucket(std::uint64_t cell) const
+    {
+        return std::size_t(((cell * 0x9E3779B97F4A7C15u) >> 32) % buckets.size());
+    }
+
+public :
+
+    using Cell = std::pair< const std::uint64_t, std::pair< std::uint32_t, std::uint32_t > >;
+
+    std::vector< std::uint32_t > indices; // of points grouped by cells, ascending within a cell
+
+    static std::uint64_t cell(std::int64_t x, std::int64_t y, std::int64_t z)
+    {
+        return (std::uint64_t(x & cellMask) << (2 * cellBits)) | (std::uint64_t(y & cellMask) << cellBits) | std::uint64_t(z & cellMask);
+    }
+
+    void cellCoordinates(const float * position, std::int64_t (& coordinates)[3]) const
+    {
+        for (int i = 0; i < 3; ++i) {
+            coordinates[i] = std::int64_t(std::floor(position[i] / cellSize));
+        }
+    }
+
+    std::uint64_t cell(const float * position) const
+    {
+        std::int64_t coordinates[3];
+        cellCoordinates(position, coordinates);
+        return cell(coordinates[0], coordinates[1], coordinates[2]);
+    }
+
+    SpatialHashGrid(const std::vector< ScenePoint > & points, float cellSize)
+        : cellSize{cellSize}
+        , buckets(std::size_t(std::max(QThread::idealThreadCount(), 1)) * 8)
+    {
+        std::vector< std::uint64_t > cells(points.size());
+        parallelFor(points.size(), [&] (std::size_t first, std::size_t last)
+        {
+            for (std::size_t i = first; i < last; ++i) {
+                cells[i] = cell(points[i].position);
+            }
+        });
+        // counting sort of the points by buckets keeps them ascending within each bucket
+        bucketOffsets.assign(buckets.size() + 1, 0);
+        for (const auto c : cells) {
+            ++bucketOffsets[bucket(c) + 1];
+        }
+        std::partial_sum(bucketOffsets.cbegin(), bucketOffsets.cend(), bucketOffsets.begin());
+        indices.resize(points.size());
+        {
+            auto offsets = bucketOffsets;
+            for (std::size_t i = 0; i < cells.size(); ++i) {
+                indices[offsets[bucket(cells[i])]++] = std::uint32_t(i);
+            }
+        }
+        parallelFor(buckets.size(), [&] (std::size_t first, std::size_t last)
+        {
+            for (std::size_t b = first; b < last; ++b) {
+                const auto begin = indices.begin() + bucketOffsets[b];
+                const auto end = indices.begin() + bucketOffsets[b + 1];
+                std::stable_sort(begin, end, [&cells] (std::uint32_t l, std::uint32_t r) { return cells[l] < cells[r]; });
+                for (auto i = begin; i != end;) {
+                    const auto c = cells[*i];
+                    const auto next = std::find_if(i, end, [&cells, c] (std::uint32_t index) { return cells[index] != c; });
+                    buckets[b].emplace(c, std::make_pair(std::uint32_t(i - indices.begin()), std::uint32_t(next - indices.begin())));
+                    i = next;
+                }
+            }
+        });
+    }
+
+    // range of indices of the points of the cell, empty if there are none
+    std::pair< std::uint32_t, std::uint32_t > find(std::uint64_t cell) const
+    {
+        const auto & cells = buckets[bucket(cell)];
+        const auto c = cells.find(cell);
+        return (c == cells.cend()) ? std::make_pair(0u, 0u) : c->second;
+    }
+
+    // function(cell) is called for every non-empty cell on the global thread pool
+    template< typename Function >
+    void forEachCell(const Function & function) const
+    {
+        parallelFor(buckets.size(), [this, &function] (std::size_t first, std::size_t last)
+        {
+            for (std::size_t b = first; b < last; ++b) {
+                for (const Cell & cell : buckets[b]) {
+                    function(cell);
+                }
+            }
+        });
+    }
+
+};
+
+// eigenvector of the least eigenvalue of symmetric matrix by cyclic Jacobi rotations
+void leastEigenvector(double (& a)[3][3], double (& v)[3])
+{
+    double e[3][3] = {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
+    for (int sweep = 0; sweep < 16; ++sweep) {
+        const double diagonal = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+        const double offDiagonal = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+        if (!(offDiagonal > 1E-24 * diagonal)) {
+            break;
+        }
+        for (int p = 0; p < 2; ++p) {
+            for (int q = p + 1; q < 3; ++q) {
+                if (a[p][q] == 0.0) {
+                    continue;
+                }
+                // rotation in the plane (p, q) which zeroes a[p][q]
+                const double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                const double t = std::copysign(1.0, theta) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                const double c = 1.0 / std::sqrt(t * t + 1.0);
+                const double s = t * c;
+                for (int k = 0; k < 3; ++k) {
+                    const double akp = a[k][p];
+                    const double akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    const double apk = a[p][k];
+                    const double aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    const double ekp = e[k][p];
+                    const double ekq = e[k][q];
+                    e[k][p] = c * ekp - s * ekq;
+                    e[k][q] = s * ekp + c * ekq;
+                }
+            }
+        }
+    }
+    int least = 0;
+    for (int i = 1; i < 3; ++i) {
+        if (a[i][i] < a[least][least]) {
+            least = i;
+        }
+    }
+    for (int k = 0; k < 3; ++k) {
+        v[k] = e[k][least];
+    }
+}
+
+}
+
+std::size_t downsample(std::vector< ScenePoint > & points, float voxelSize, int maxVoxelPoints)
+{
+    if (points.empty() || !(voxelSize > 0.0f) || !(maxVoxelPoints > 0)) {
+        return 0;
+    }
+    const SpatialHashGrid grid{points, voxelSize};
+    const auto cap = std::uint32_t(maxVoxelPoints);
+    std::vector< std::uint8_t > kept(points.size(), 0);
+    grid.forEachCell([&] (const SpatialHashGrid::Cell & cell)
+    {
+        const auto first = cell.second.first;
+        const auto count = cell.second.second - first;
+        if (!(cap < count)) {
+            for (std::uint32_t i = 0; i < count; ++i) {
+                kept[grid.indices[first + i]] = 1;
+            }
+            return;
+        }
+        // oversampled voxels are near the scanner, where neighbouring points of the scan are neighbouring in space too
+        for (std::uint32_t i = 0; i < cap; ++i) {
+            kept[grid.indices[first + std::uint32_t(std::uint64_t(i) * count / cap)]] = 1;
+        }
+    });
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < points.size(); ++i) {
+        if (kept[i] != 0) {
+            points[size++] = points[i];
+        }
+    }
+    const std::size_t removed = points.size() - size;
+    points.resize(size);
+    qCInfo(pointCloudCategory) << QStringLiteral("%1 points are removed by voxel grid of size %2 with at most %3 points per voxel, %4 points are left")
+                                  .arg(removed).arg(voxelSize).arg(maxVoxelPoints).arg(size);
+    return removed;
+}
+
+std::size_t estimateNormals(std::vector< ScenePoint > & points, int neighbourCount, float radius, const float (& viewpoint)[3])
+{
+    if (points.empty() || !(radius > 0.0f) || (neighbourCount < 3)) {
+        return 0;
+    }
+    // neighbours within radius are in the cell of the point or in adjacent ones
+    const SpatialHashGrid grid{points, radius};
+    const float radiusSquared = radius * radius;
+    std::atomic< std::size_t > estimated{0};
+    parallelFor(points.size(), [&] (std::size_t first, std::size_t last)
+    {
+        std::vector< std::pair< float, std::uint32_t > > neighbours; // squared distance, index
+        std::size_t blockEstimated = 0;
+        for (std::size_t i = first; i < last; ++i) {
+            const auto & position = points[i].position;
+            neighbours.clear();
+            std::int64_t c[3];
+            grid.cellCoordinates(position, c);
+            for (int dx = -1; dx < 2; ++dx) {
+                for (int dy = -1; dy < 2; ++dy) {
+                    for (int dz = -1; dz < 2; ++dz) {
+                        const auto range = grid.find(SpatialHashGrid::cell(c[0] + dx, c[1] + dy, c[2] + dz));
+                        for (auto j = range.first; j < range.second; ++j) {
+                            const auto index = grid.indices[j];
+                            const auto & p = points[index].position;
+                            const float distanceSquared = (p[0] - position[0]) * (p[0] - position[0]) + (p[1] - position[1]) * (p[1] - position[1]) + (p[2] - position[2]) * (p[2] - position[2]);
+                            if (!(radiusSquared < distanceSquared)) {
+                                neighbours.emplace_back(distanceSquared, index);
+                            }
+                        }
+                    }
+                }
+            }
+            // aliased cells may be visited twice
+            std::sort(neighbours.begin(), neighbours.end());
+            neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+            if (neighbours.size() < 3) {
+                std::fill_n(points[i].normal, 3, 0.0f);
+                continue;
+            }
+            neighbours.resize(std::min(neighbours.size(), std::size_t(neighbourCount)));
+            // covariance about the centroid, relative to the point for precision
+            double centroid[3] = {};
+            for (const auto & neighbour : neighbours) {
+                for (int k = 0; k < 3; ++k) {
+                    centroid[k] += double(points[neighbour.second].position[k]) - double(position[k]);
+                }
+            }
+            for (auto & coordinate : centroid) {
+                coordinate /= double(neighbours.size());
+            }
+            double covariance[3][3] = {};
+            for (const auto & neighbour : neighbours) {
+                double d[3];
+                for (int k = 0; k < 3; ++k) {
+                    d[k] = double(points[neighbour.second].position[k]) - double(position[k]) - centroid[k];
+                }
+                for (int k = 0; k < 3; ++k) {
+                    for (int l = 0; l < 3; ++l) {
+                        covariance[k][l] += d[k] * d[l];
+                    }
+                }
+            }
+            double normal[3];
+            leastEigenvector(covariance, normal);
+            double towardsViewpoint = 0.0;
+            for (int k = 0; k < 3; ++k) {
+                towardsViewpoint += normal[k] * (double(viewpoint[k]) - double(position[k]));
+            }
+            const double sign = (towardsViewpoint < 0.0) ? -1.0 : 1.0;
+            for (int k = 0; k < 3; ++k) {
+                points[i].normal[k] = float(sign * normal[k]);
+            }
+            ++blockEstimated;
+        }
+        estimated += blockEstimated;
+    });
+    qCInfo(pointCloudCategory) << QStringLiteral("normals of %1 of %2 points are estimated from %3 nearest neighbours within radius %4")
+                                  .arg(estimated.load()).arg(points.size()).arg(neighbourCount).arg(radius);
+    return estimated;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QtCore>
+
+#include "scene.cuh"
+
+#include <vector>
+
+#include <cstddef>
+
+Q_DECLARE_LOGGING_CATEGORY(pointCloudCategory)
+
+// preprocessing of scans before they are written by writeScene(); both stages run on all cores of global thread pool
+// points are grouped into cubic cells by spatial hash grid, which is also built in parallel
+
+// density cap: points of each voxel in excess of maxVoxelPoints are removed, the kept ones are spread evenly over the order of the scan
+// order of the remaining points is preserved, result does not depend on the number of threads; returns number of removed points
+std::size_t downsample(std::vector< ScenePoint > & points, float voxelSize, int maxVoxelPoints = 1);
+
+// normal of each point is the direction of the least variance (PCA) of its k nearest neighbours within radius (including the point)
+// it is oriented towards the viewpoint (position of the scanner); points with less than 3 neighbours get zero (unknown) normal
+// returns number of points with estimated normals
+std::size_t estimateNormals(std::vector< ScenePoint > & points, int neighbourCount, float radius, const float (& viewpoint)[3]);
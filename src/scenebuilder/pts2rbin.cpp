@@ -0,0 +1,99 @@
+#include "scenebuilder.hpp"
+#include "pointcloud.hpp"
+
+#include <QtCore>
+
+#include <vector>
+
+#include <cstdlib>
+
+Q_DECLARE_LOGGING_CATEGORY(pts2rbinCategory)
+Q_LOGGING_CATEGORY(pts2rbinCategory, "pts2rbin")
+
+// Leica PTS: optional line with the number of points, then lines "x y z [intensity [r g b]]", intensity is in [-2048; 2047]
+static bool readPts(const QString & fileName, std::vector< ScenePoint > & points)
+{
+    QFile file{fileName};
+    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+        qCWarning(pts2rbinCategory) << QStringLiteral("unable to open file %1 to read").arg(fileName);
+        return false;
+    }
+    QByteArray line;
+    while (!file.atEnd()) {
+        line = file.readLine();
+        const auto fields = line.simplified().split(' ');
+        if (fields.size() == 1) {
+            if (points.empty()) {
+                points.reserve(std::size_t(fields.first().toULongLong()));
+            }
+            continue;
+        }
+        if (fields.size() < 3) {
+            continue;
+        }
+        ScenePoint point = {};
+        bool ok = true;
+        for (int i = 0; ok && (i < 3); ++i) {
+            point.position[i] = fields.at(i).toFloat(&ok);
+        }
+        if (!ok) {
+            qCWarning(pts2rbinCategory) << QStringLiteral("malformed line %1 is skipped").arg(QString::fromLatin1(line.trimmed()));
+            continue;
+        }
+        point.intensity = (fields.size() > 3) ? (fields.at(3).toFloat() + 2048.0f) / 4095.0f : 1.0f;
+        if (fields.size() > 6) {
+            point.color = ((fields.at(4).toUInt() & 0xFF) << 16) | ((fields.at(5).toUInt() & 0xFF) << 8) | (fields.at(6).toUInt() & 0xFF);
+        } else {
+            point.color = 0xFFFFFF;
+        }
+        points.push_back(point);
+    }
+    qCInfo(pts2rbinCategory) << QStringLiteral("%1 points are read from %2").arg(points.size()).arg(fileName);
+    return true;
+}
+
+int main(int argc, char * argv [])
+{
+    QCoreApplication application{argc, argv};
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Converts scan in Leica PTS format to scene file: downsamples it, estimates normals and builds the hierarchy"));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("input"), QStringLiteral("Scan file (*.pts)."));
+    parser.addPositionalArgument(QStringLiteral("output"), QStringLiteral("Scene file (*.rbin)."));
+    const QCommandLineOption voxelSizeOption{QStringLiteral("voxel-size"), QStringLiteral("Edge of the voxels of density cap, 0 disables downsampling."), QStringLiteral("size"), QStringLiteral("0")};
+    const QCommandLineOption voxelPointsOption{QStringLiteral("voxel-points"), QStringLiteral("Maximum number of points per voxel."), QStringLiteral("count"), QStringLiteral("1")};
+    const QCommandLineOption neighboursOption{QStringLiteral("neighbours"), QStringLiteral("Number of nearest neighbours for normal estimation, 0 disables it."), QStringLiteral("count"), QStringLiteral("16")};
+    const QCommandLineOption normalRadiusOption{QStringLiteral("normal-radius"), QStringLiteral("Radius of the neighbourhood for normal estimation."), QStringLiteral("radius"), QStringLiteral("0.05")};
+    const QCommandLineOption viewpointOption{QStringLiteral("viewpoint"), QStringLiteral("Position of the scanner, normals are oriented towards it."), QStringLiteral("x,y,z"), QStringLiteral("0,0,0")};
+    const QCommandLineOption pointRadiusOption{QStringLiteral("point-radius"), QStringLiteral("Radius of the spheres of the points."), QStringLiteral("radius"), QStringLiteral("0.005")};
+    const QCommandLineOption leafSizeOption{QStringLiteral("leaf-size"), QStringLiteral("Maximum number of points per leaf."), QStringLiteral("count"), QStringLiteral("4")};
+    parser.addOptions({voxelSizeOption, voxelPointsOption, neighboursOption, normalRadiusOption, viewpointOption, pointRadiusOption, leafSizeOption});
+    parser.process(application);
+
+    const auto arguments = parser.positionalArguments();
+    if (arguments.size() != 2) {
+        parser.showHelp(EXIT_FAILURE);
+    }
+    const auto viewpointCoordinates = parser.value(viewpointOption).split(QLatin1Char(','));
+    if (viewpointCoordinates.size() != 3) {
+        qCWarning(pts2rbinCategory) << QStringLiteral("invalid viewpoint %1").arg(parser.value(viewpointOption));
+        return EXIT_FAILURE;
+    }
+    const float viewpoint[3] = {viewpointCoordinates.at(0).toFloat(), viewpointCoordinates.at(1).toFloat(), viewpointCoordinates.at(2).toFloat()};
+
+    std::vector< ScenePoint > points;
+    if (!readPts(arguments.at(0), points)) {
+        return EXIT_FAILURE;
+    }
+    QElapsedTimer elapsedTimer;
+    elapsedTimer.start();
+    // normals are estimated after downsampling, otherwise nearest neighbours in oversampled regions span too small patch to average out the noise
+    downsample(points, parser.value(voxelSizeOption).toFloat(), parser.value(voxelPointsOption).toInt());
+    estimateNormals(points, parser.value(neighboursOption).toInt(), parser.value(normalRadiusOption).toFloat(), viewpoint);
+    qCInfo(pts2rbinCategory) << QStringLiteral("preprocessing took %1 ms on %2 threads").arg(elapsedTimer.elapsed()).arg(QThreadPool::globalInstance()->maxThreadCount());
+    if (!writeScene(arguments.at(1), points, parser.value(pointRadiusOption).toFloat(), parser.value(leafSizeOption).toInt())) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
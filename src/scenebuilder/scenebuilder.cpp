@@ -0,0 +1,163 @@
+#include "scenebuilder.hpp"
+
+#include <algorithm>
+#include <limits>
+
+Q_LOGGING_CATEGORY(sceneBuilderCategory, "sceneBuilder")
+
+namespace
+{
+
+class HierarchyBuilder
+{
+
+    std::vector< ScenePoint > & points;
+    const float pointRadius;
+    const std::uint32_t leafSize;
+
+    static SceneBox emptyBox()
+    {
+        constexpr auto infinity = std::numeric_limits< float >::infinity();
+        return {{infinity, infinity, infinity}, {-infinity, -infinity, -infinity}};
+    }
+
+    SceneBox bounds(std::uint32_t first, std::uint32_t last, float radius) const
+    {
+        auto box = emptyBox();
+        for (std::uint32_t i = first; i < last; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                box.min[j] = std::min(box.min[j], points[i].position[j] - radius);
+                box.max[j] = std::max(box.max[j], points[i].position[j] + radius);
+            }
+        }
+        return box;
+    }
+
+    // nodes are appended in depth-first order, ropes are set by the caller
+    void build(std::uint32_t first, std::uint32_t last, int depth)
+    {
+        const auto node = std::int32_t(nodes.size());
+        nodes.push_back({bounds(first, last, pointRadius), -1, -1, first, last - first});
+        // median split keeps the tree balanced, so depth is logarithmic, but duplicates of points are not split further
+        if (!(leafSize < last - first) || !(depth + 1 < sceneMaxDepth)) {
+            return;
+        }
+        const auto centroids = bounds(first, last, 0.0f);
+        int axis = 0;
+        for (int j = 1; j < 3; ++j) {
+            if (centroids.max[axis] - centroids.min[axis] < centroids.max[j] - centroids.min[j]) {
+                axis = j;
+            }
+        }
+        if (!(centroids.min[axis] < centroids.max[axis])) {
+            return;
+        }
+        const auto middle = first + (last - first) / 2;
+        std::nth_element(points.begin() + first, points.begin() + middle, points.begin() + last, [axis] (const ScenePoint & l, const ScenePoint & r)
+        {
+            return l.position[axis] < r.position[axis];
+        });
+        build(first, middle, depth + 1);
+        nodes[node].right = std::int32_t(nodes.size());
+        build(middle, last, depth + 1);
+        nodes[node].first = 0;
+        nodes[node].count = 0;
+    }
+
+    void link(std::int32_t node, std::int32_t rope)
+    {
+        nodes[node].rope = rope;
+        const auto right = nodes[node].right;
+        if (right < 0) {
+            return;
+        }
+        link(node + 1, right);
+        link(right, rope);
+    }
+
+public :
+
+    std::vector< SceneNode > nodes;
+
+    HierarchyBuilder(std::vector< ScenePoint > & points, float pointRadius, int leafSize)
+        : points{points}
+        , pointRadius{pointRadius}
+        , leafSize{std::uint32_t(std::max(leafSize, 1))}
+    { ; }
+
+    void build()
+    {
+        nodes.clear();
+        if (points.empty()) {
+            return;
+        }
+        nodes.reserve(2 * (points.size() / leafSize + 1));
+        build(0, std::uint32_t(points.size()), 0);
+        link(0, -1);
+    }
+
+};
+
+std::uint64_t alignUp(std::uint64_t offset)
+{
+    return (offset + 15) & ~std::uint64_t(15);
+}
+
+}
+
+bool writeScene(QIODevice & device, std::vector< ScenePoint > & points, float pointRadius, int leafSize)
+{
+    if (!(points.size() < std::numeric_limits< std::uint32_t >::max())) {
+        qCWarning(sceneBuilderCategory) << QStringLiteral("too many points: %1").arg(points.size());
+        return false;
+    }
+    HierarchyBuilder hierarchyBuilder{points, pointRadius, leafSize};
+    hierarchyBuilder.build();
+    const auto & nodes = hierarchyBuilder.nodes;
+    SceneHeader header = {};
+    header.signature[0] = 1;
+    header.signature[1] = 8;
+    header.signature[2] = 0;
+    header.signature[3] = 42;
+    header.version = sceneVersion;
+    header.nodeCount = std::uint32_t(nodes.size());
+    header.pointCount = std::uint32_t(points.size());
+    header.nodeOffset = alignUp(sizeof header);
+    header.pointOffset = alignUp(header.nodeOffset + sizeof(SceneNode) * nodes.size());
+    header.bounds = nodes.empty() ? SceneBox{} : nodes.front().box;
+    header.pointRadius = pointRadius;
+    const auto write = [&device] (const void * data, std::uint64_t size)
+    {
+        return device.write(static_cast< const char * >(data), qint64(size)) == qint64(size);
+    };
+    const char padding[16] = {};
+    const auto pad = [&] (std::uint64_t size)
+    {
+        return write(padding, alignUp(size) - size);
+    };
+    const auto nodesSize = sizeof(SceneNode) * nodes.size();
+    if (!write(&header, sizeof header) || !pad(sizeof header) || !write(nodes.data(), nodesSize) || !pad(header.nodeOffset + nodesSize) || !write(points.data(), sizeof(ScenePoint) * points.size())) {
+        qCWarning(sceneBuilderCategory) << QStringLiteral("unable to write scene: %1").arg(device.errorString());
+        return false;
+    }
+    return true;
+}
+
+bool writeScene(const QString & fileName, std::vector< ScenePoint > & points, float pointRadius, int leafSize)
+{
+    QSaveFile file{fileName};
+    if (!file.open(QFile::WriteOnly)) {
+        qCWarning(sceneBuilderCategory) << QStringLiteral("unable to open file %1 to write").arg(fileName);
+        return false;
+    }
+    if (!writeScene(file, points, pointRadius, leafSize)) {
+        file.cancelWriting();
+        return false;
+    }
+    if (!file.commit()) {
+        qCWarning(sceneBuilderCategory) << QStringLiteral("unable to write file %1").arg(fileName);
+        return false;
+    }
+    qCInfo(sceneBuilderCategory) << QStringLiteral("scene of %1 points is written to %2").arg(points.size()).arg(fileName);
+    return true;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QtCore>
+
+#include "scene.cuh"
+
+#include <vector>
+
+Q_DECLARE_LOGGING_CATEGORY(sceneBuilderCategory)
+
+// writes scene file of the points: bounding volume hierarchy is built by median split along the longest axis
+// points are reordered to follow leaves of the hierarchy
+bool writeScene(QIODevice & device, std::vector< ScenePoint > & points, float pointRadius, int leafSize = 4);
+bool writeScene(const QString & fileName, std::vector< ScenePoint > & points, float pointRadius, int leafSize = 4);
@@ -0,0 +1,100 @@
+#include "testscenes.hpp"
+
+#include <cmath>
+
+std::uint32_t hash(std::uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float noise(std::uint32_t x)
+{
+    return (hash(x) >> 8) * (1.0f / (1u << 24));
+}
+
+ScenePoint makePoint(const QVector3D & position, const QVector3D & normal, QRgb color)
+{
+    ScenePoint point = {};
+    point.position[0] = position.x();
+    point.position[1] = position.y();
+    point.position[2] = position.z();
+    point.color = color & 0xFFFFFFu;
+    point.normal[0] = normal.x();
+    point.normal[1] = normal.y();
+    point.normal[2] = normal.z();
+    point.intensity = 1.0f;
+    return point;
+}
+
+std::vector< ScenePoint > sphereScene(int count, const QVector3D & centre)
+{
+    const float goldenAngle = float(M_PI) * (3.0f - std::sqrt(5.0f));
+    std::vector< ScenePoint > points;
+    points.reserve(std::size_t(count));
+    for (int i = 0; i < count; ++i) {
+        const float y = 1.0f - (2.0f * i + 1.0f) / count;
+        const float r = std::sqrt(1.0f - y * y);
+        const float phi = goldenAngle * i;
+        const QVector3D normal{r * std::cos(phi), y, r * std::sin(phi)};
+        const QVector3D c = (normal + QVector3D{1.0f, 1.0f, 1.0f}) * 127.5f;
+        points.push_back(makePoint(centre + normal, normal, qRgb(int(c.x()), int(c.y()), int(c.z()))));
+    }
+    return points;
+}
+
+std::vector< ScenePoint > boxScene()
+{
+    const int groundSize = 200;
+    const float groundExtent = 4.0f;
+    const float step = 2.0f * groundExtent / groundSize;
+    std::vector< ScenePoint > points;
+    for (int i = 0; i < groundSize; ++i) {
+        for (int j = 0; j < groundSize; ++j) {
+            const std::uint32_t seed = std::uint32_t(i * groundSize + j) * 2;
+            const float x = -groundExtent + step * (i + noise(seed));
+            const float z = -groundExtent + step * (j + noise(seed + 1));
+            const bool checker = ((i / 20) + (j / 20)) % 2 == 0;
+            points.push_back(makePoint({x, -1.0f, z}, {0.0f, 1.0f, 0.0f}, checker ? qRgb(200, 200, 200) : qRgb(90, 110, 140)));
+        }
+    }
+    const int faceSize = 60;
+    const float boxStep = 1.0f / faceSize;
+    for (int axis = 0; axis < 3; ++axis) {
+        for (float side : {-1.0f, 1.0f}) {
+            QVector3D normal;
+            normal[axis] = side;
+            for (int i = 0; i < faceSize; ++i) {
+                for (int j = 0; j < faceSize; ++j) {
+                    QVector3D position;
+                    position[axis] = 0.5f * side;
+                    position[(axis + 1) % 3] = -0.5f + boxStep * (i + 0.5f);
+                    position[(axis + 2) % 3] = -0.5f + boxStep * (j + 0.5f);
+                    position[1] -= 0.5f; // stand on the ground
+                    points.push_back(makePoint(position, normal, qRgb(220, 80, 40)));
+                }
+            }
+        }
+    }
+    return points;
+}
+
+std::vector< ScenePoint > noisyPlane(int size, float spacing, float amplitude)
+{
+    std::vector< ScenePoint > points;
+    points.reserve(std::size_t(size) * size);
+    for (int i = 0; i < size; ++i) {
+        for (int j = 0; j < size; ++j) {
+            const auto id = std::uint32_t(i * size + j);
+            const float x = spacing * (i + noise(3 * id));
+            const float y = spacing * (j + noise(3 * id + 1));
+            const float z = amplitude * (2.0f * noise(3 * id + 2) - 1.0f);
+            points.push_back(makePoint({x, y, z}, {}, id));
+        }
+    }
+    return points;
+}
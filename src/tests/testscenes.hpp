@@ -0,0 +1,25 @@
+#pragma once
+
+#include <QtGui>
+
+#include "scene.cuh"
+
+#include <vector>
+
+#include <cstdint>
+
+// synthetic scenes shared by the tests, generated deterministically on every platform
+
+// deterministic noise independent of the platform random number generators
+std::uint32_t hash(std::uint32_t x);
+// uniform in [0; 1)
+float noise(std::uint32_t x);
+
+ScenePoint makePoint(const QVector3D & position, const QVector3D & normal, QRgb color);
+
+// unit sphere covered by Fibonacci lattice, coloured by normal
+std::vector< ScenePoint > sphereScene(int count, const QVector3D & centre = {});
+// jittered ground grid with a box standing on it: shadows and occlusion are well pronounced
+std::vector< ScenePoint > boxScene();
+// jittered grid in plane z = 0 with noise along z small compared to the spacing, colours are indices of the points
+std::vector< ScenePoint > noisyPlane(int size, float spacing, float amplitude);
@@ -0,0 +1,172 @@
+#include "camera.hpp"
+#include "frameimage.hpp"
+#include "scenefile.hpp"
+#include "scenebuilder.hpp"
+#include "tileprotocol.hpp"
+#include "testscenes.hpp"
+
+#include <QtGui>
+#include <QtNetwork>
+#include <QtTest>
+
+#include "rt.cuh"
+
+#include <algorithm>
+#include <vector>
+
+// headless sort-first rendering: frame assembled by coordinator from strips of worker processes
+// is compared to the frame rendered by single process, loss of a worker during a frame is recovered
+
+namespace
+{
+
+const QSize frameSize = {320, 240};
+const int timeout = 60000; // ms
+
+// the same camera and quantization as the coordinator uses
+QImage renderSingleProcess(const QUrl & source)
+{
+    SceneFile sceneFile;
+    if (!sceneFile.setSource(source)) {
+        return {};
+    }
+    Camera camera;
+    camera.setProperty("aspectRatio", float(frameSize.width()) / float(frameSize.height()));
+    RenderParameters parameters = {};
+    parameters.scene = sceneFile.devicePointer();
+    parameters.shading = {HeadlightShading, {0.0f, 0.0f, 1.0f}, 0.0f, 0};
+    const auto inverseTransformationMatrix = windowToWorldMatrix(camera.transformationMatrix(), frameSize);
+    std::copy_n(inverseTransformationMatrix.constData(), 16, parameters.inverseTransformationMatrix);
+    std::vector< float > pixels(std::size_t(frameSize.width()) * frameSize.height() * 3);
+    if (!CUDA_renderToHost(pixels.data(), parameters, 0, 0, frameSize.width(), frameSize.height())) {
+        return {};
+    }
+    return frameImage(pixels.data(), frameSize);
+}
+
+}
+
+class DistributedTest
+        : public QObject
+{
+
+    Q_OBJECT
+
+    QTemporaryDir directory;
+    QUrl source;
+    QImage expected;
+
+    QString address() const
+    {
+        return QStringLiteral("tst_distributed-%1").arg(QCoreApplication::applicationPid());
+    }
+
+    QString outputFileName() const
+    {
+        return directory.filePath(QStringLiteral("frame.png"));
+    }
+
+    void startCoordinator(QProcess & coordinator, int spawn, int workers)
+    {
+        QFile::remove(outputFileName());
+        coordinator.setProcessChannelMode(QProcess::MergedChannels);
+        coordinator.start(QStringLiteral(RENDERER_EXECUTABLE), {
+                              QStringLiteral("--coordinator"),
+                              QStringLiteral("--listen"), address(),
+                              QStringLiteral("--spawn"), QString::number(spawn),
+                              QStringLiteral("--workers"), QString::number(workers),
+                              QStringLiteral("--source"), source.toLocalFile(),
+                              QStringLiteral("--size"), QStringLiteral("%1x%2").arg(frameSize.width()).arg(frameSize.height()),
+                              QStringLiteral("--output"), outputFileName(),
+                          });
+    }
+
+    // returns log of the coordinator and its workers
+    QString finishCoordinator(QProcess & coordinator)
+    {
+        const bool finished = coordinator.waitForFinished(timeout);
+        if (!finished) {
+            coordinator.kill();
+            coordinator.waitForFinished();
+        }
+        const auto log = QString::fromLocal8Bit(coordinator.readAll());
+        if (!finished || (coordinator.exitStatus() != QProcess::NormalExit) || (coordinator.exitCode() != EXIT_SUCCESS)) {
+            qWarning().noquote() << log;
+            return {};
+        }
+        return log;
+    }
+
+private Q_SLOTS :
+
+    void initTestCase()
+    {
+        if (!CUDA_init()) {
+            QSKIP("no CUDA device capable to map host memory");
+        }
+        QVERIFY(directory.isValid());
+        const auto fileName = directory.filePath(QStringLiteral("sphere.rbin"));
+        // unit sphere in front of the default camera
+        auto points = sphereScene(20000, {0.0f, 0.0f, -3.0f});
+        QVERIFY(writeScene(fileName, points, 0.03f));
+        source = QUrl::fromLocalFile(fileName);
+        expected = renderSingleProcess(source);
+        QVERIFY(!expected.isNull());
+    }
+
+    void assembledFrame()
+    {
+        QProcess coordinator;
+        startCoordinator(coordinator, 2, 2);
+        const auto log = finishCoordinator(coordinator);
+        QVERIFY(!log.isEmpty());
+        QVERIFY2(log.contains(QStringLiteral("by 2 workers")), qPrintable(log));
+        QImage actual;
+        QVERIFY(actual.load(outputFileName()));
+        // pixels are traced independently, so strips are the same as the parts of the whole frame
+        QCOMPARE(actual.convertToFormat(QImage::Format_RGB888), expected);
+    }
+
+    // the second worker is played by the test: it takes its strip and disconnects without result
+    void lostWorker()
+    {
+        QProcess coordinator;
+        startCoordinator(coordinator, 1, 2);
+        QLocalSocket socket;
+        QDeadlineTimer deadline{timeout};
+        for (;;) {
+            socket.connectToServer(address());
+            if (socket.waitForConnected()) {
+                break;
+            }
+            QVERIFY2(!deadline.hasExpired(), qPrintable(socket.errorString()));
+            QTest::qWait(100);
+        }
+        QDataStream stream{&socket};
+        stream.setVersion(tileProtocolVersion);
+        TileRequest tileRequest;
+        for (;;) {
+            QVERIFY2(socket.waitForReadyRead(timeout), "no tile is requested");
+            stream.startTransaction();
+            stream >> tileRequest;
+            if (stream.commitTransaction()) {
+                break;
+            }
+        }
+        QCOMPARE(tileRequest.frame, quint64(1));
+        QVERIFY(!tileRequest.tile.isEmpty());
+        socket.abort();
+
+        const auto log = finishCoordinator(coordinator);
+        QVERIFY(!log.isEmpty());
+        QVERIFY2(log.contains(QStringLiteral("frame 1 is restarted on 1 workers")), qPrintable(log));
+        QImage actual;
+        QVERIFY(actual.load(outputFileName()));
+        QCOMPARE(actual.convertToFormat(QImage::Format_RGB888), expected);
+    }
+
+};
+
+QTEST_GUILESS_MAIN(DistributedTest)
+
+#include "tst_distributed.moc"
@@ -0,0 +1,146 @@
+#include "pointcloud.hpp"
+#include "testscenes.hpp"
+
+#include <QtTest>
+
+#include <vector>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// preprocessing of scans: density cap and normal estimation on synthetic point clouds
+
+namespace
+{
+
+bool isEqual(const std::vector< ScenePoint > & l, const std::vector< ScenePoint > & r)
+{
+    return (l.size() == r.size()) && (std::memcmp(l.data(), r.data(), l.size() * sizeof(ScenePoint)) == 0);
+}
+
+}
+
+class PointCloudTest
+        : public QObject
+{
+
+    Q_OBJECT
+
+    int maxThreadCount = 0;
+
+private Q_SLOTS :
+
+    void init()
+    {
+        maxThreadCount = QThreadPool::globalInstance()->maxThreadCount();
+    }
+
+    void cleanup()
+    {
+        QThreadPool::globalInstance()->setMaxThreadCount(maxThreadCount);
+    }
+
+    void normalsFaceViewpoint_data()
+    {
+        QTest::addColumn< float >("viewpointZ");
+
+        QTest::newRow("above") << 5.0f;
+        QTest::newRow("below") << -5.0f;
+    }
+
+    void normalsFaceViewpoint()
+    {
+        QFETCH(float, viewpointZ);
+
+        const int size = 100;
+        const float spacing = 0.01f;
+        auto points = noisyPlane(size, spacing, 0.1f * spacing);
+        const float viewpoint[3] = {0.3f, 0.7f, viewpointZ};
+        QCOMPARE(estimateNormals(points, 16, 4.0f * spacing, viewpoint), points.size());
+        for (const ScenePoint & point : points) {
+            const float length = std::sqrt(point.normal[0] * point.normal[0] + point.normal[1] * point.normal[1] + point.normal[2] * point.normal[2]);
+            QVERIFY2(std::fabs(length - 1.0f) < 1E-4f, qPrintable(QStringLiteral("normal of point %1 is not unit: %2").arg(point.color).arg(length)));
+            // the plane is z = 0 up to noise, so the normal is close to the z axis and points to the side of the viewpoint
+            const float facing = point.normal[2] * std::copysign(1.0f, viewpointZ);
+            QVERIFY2(0.95f < facing, qPrintable(QStringLiteral("normal of point %1 is (%2, %3, %4)").arg(point.color).arg(point.normal[0]).arg(point.normal[1]).arg(point.normal[2])));
+        }
+    }
+
+    void isolatedPointsGetZeroNormal()
+    {
+        std::vector< ScenePoint > points = {makePoint({0.0f, 0.0f, 0.0f}, {}, 0), makePoint({10.0f, 0.0f, 0.0f}, {}, 1)};
+        points[0].normal[2] = 1.0f;
+        const float viewpoint[3] = {0.0f, 0.0f, 1.0f};
+        QCOMPARE(estimateNormals(points, 16, 1.0f, viewpoint), std::size_t(0));
+        for (const ScenePoint & point : points) {
+            QCOMPARE(point.normal[0], 0.0f);
+            QCOMPARE(point.normal[1], 0.0f);
+            QCOMPARE(point.normal[2], 0.0f);
+        }
+    }
+
+    void voxelCap_data()
+    {
+        QTest::addColumn< int >("maxVoxelPoints");
+
+        QTest::newRow("1") << 1;
+        QTest::newRow("3") << 3;
+        QTest::newRow("unlimited") << 100;
+    }
+
+    void voxelCap()
+    {
+        QFETCH(int, maxVoxelPoints);
+
+        // voxel v of the unit grid gets v + 1 points, points of different voxels are interleaved in the scan order
+        const int voxelCount = 10;
+        std::vector< ScenePoint > points;
+        std::vector< int > voxelPoints(voxelCount, 0);
+        std::size_t expectedSize = 0;
+        for (int v = 0; v < voxelCount; ++v) {
+            expectedSize += std::size_t(qMin(v + 1, maxVoxelPoints));
+        }
+        for (int round = 0; round < voxelCount; ++round) {
+            for (int v = round; v < voxelCount; ++v) {
+                const auto id = std::uint32_t(points.size());
+                points.push_back(makePoint({v + 0.1f + 0.8f * noise(2 * id), 0.1f + 0.8f * noise(2 * id + 1), 0.5f}, {}, id));
+            }
+        }
+        const std::size_t size = points.size();
+        QCOMPARE(downsample(points, 1.0f, maxVoxelPoints), size - expectedSize);
+        QCOMPARE(points.size(), expectedSize);
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            if (0 < i) {
+                QVERIFY2(points[i - 1].color < points[i].color, "order of the points is not preserved");
+            }
+            ++voxelPoints[int(std::floor(points[i].position[0]))];
+        }
+        for (int v = 0; v < voxelCount; ++v) {
+            QCOMPARE(voxelPoints[v], qMin(v + 1, maxVoxelPoints));
+        }
+    }
+
+    void singleThreadMatches()
+    {
+        const auto input = noisyPlane(200, 0.01f, 0.005f);
+        const float viewpoint[3] = {1.0f, 1.0f, 2.0f};
+        const auto preprocess = [&input, &viewpoint]
+        {
+            auto points = input;
+            downsample(points, 0.02f, 2);
+            estimateNormals(points, 12, 0.05f, viewpoint);
+            return points;
+        };
+        const auto parallel = preprocess();
+        QThreadPool::globalInstance()->setMaxThreadCount(1);
+        const auto sequential = preprocess();
+        QCOMPARE(parallel.size(), sequential.size());
+        QVERIFY2(isEqual(parallel, sequential), "result depends on the number of threads");
+    }
+
+};
+
+QTEST_GUILESS_MAIN(PointCloudTest)
+
+#include "tst_pointcloud.moc"
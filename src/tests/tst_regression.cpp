@@ -0,0 +1,319 @@
+#include "camera.hpp"
+#include "frameimage.hpp"
+#include "scenefile.hpp"
+#include "scenebuilder.hpp"
+#include "testscenes.hpp"
+
+#include <QtGui>
+#include <QtTest>
+
+#include "rt.cuh"
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include <cmath>
+#include <cstdint>
+
+// end-to-end regression of the headless rendering path (the one tile workers use):
+// images of generated scenes are compared to golden images by perceptual colour difference,
+// median frame time and device memory taken by the frames are compared to the baseline of the machine,
+// case without golden image or baseline is skipped (after the check of the other one) until they are recorded
+//
+// environment:
+//     RENDERER_UPDATE_GOLDEN=1 - record rendered images as golden ones (on a CUDA device, then commit them)
+//     RENDERER_UPDATE_BASELINE=1 - record measured performance as the baseline (once per machine)
+//     RENDERER_PERFORMANCE_BASELINE - path to the baseline (default is performance-<host name>.json in application data location)
+
+namespace
+{
+
+const QSize frameSize = {256, 192};
+const int frameRepeats = 7;
+
+// per-pixel colour difference (CIE76) noticeable at a glance
+const double differenceThreshold = 10.0;
+const double meanDifferenceTolerance = 1.0;
+const double differentPixelsTolerance = 0.005;
+
+const double frameTimeTolerance = 1.20;
+const double memoryTolerance = 1.10;
+
+bool isEnvironmentSet(const char * name)
+{
+    return qEnvironmentVariableIntValue(name) != 0;
+}
+
+struct Pose
+{
+
+    const char * name;
+    CameraLens::ProjectionType projectionType;
+    QVector3D position; // of the eye
+    QVector3D target;
+
+};
+
+const Pose poses[] = {
+    {"front", CameraLens::PerspectiveProjection, {0.0f, 0.5f, 3.0f}, {0.0f, -0.25f, 0.0f}},
+    {"above", CameraLens::PerspectiveProjection, {2.0f, 3.0f, 2.0f}, {0.0f, -0.5f, 0.0f}},
+    {"orthographic", CameraLens::OrthographicProjection, {3.0f, 1.0f, 3.0f}, {0.0f, -0.5f, 0.0f}},
+};
+
+Shading shading(ShadingMode mode)
+{
+    Shading shading = {mode, {0.0f, 0.0f, 1.0f}, 0.0f, 0};
+    if (mode != HeadlightShading) {
+        const QVector3D lightDirection = QVector3D{0.4f, 1.0f, 0.6f}.normalized();
+        shading.lightDirection[0] = lightDirection.x();
+        shading.lightDirection[1] = lightDirection.y();
+        shading.lightDirection[2] = lightDirection.z();
+    }
+    if (mode == AmbientOcclusionShading) {
+        shading.occlusionRadius = 0.5f;
+        shading.occlusionSamples = 16;
+    }
+    return shading;
+}
+
+QMatrix4x4 transformationMatrix(const Pose & pose)
+{
+    Camera camera;
+    {
+        CameraUpdate cameraUpdate{&camera};
+        camera.setProperty("projectionType", pose.projectionType);
+        camera.setProperty("aspectRatio", float(frameSize.width()) / float(frameSize.height()));
+        camera.setProperty("fieldOfView", 60.0f);
+        const float halfHeight = 1.5f;
+        const float halfWidth = halfHeight * frameSize.width() / frameSize.height();
+        camera.setProperty("left", -halfWidth);
+        camera.setProperty("right", halfWidth);
+        camera.setProperty("bottom", -halfHeight);
+        camera.setProperty("top", halfHeight);
+        // camera transformation is the view one: the world is moved to the eye, then rotated
+        camera.setProperty("position", -pose.position);
+        camera.setProperty("rotation", QQuaternion::fromDirection(pose.position - pose.target, {0.0f, 1.0f, 0.0f}).conjugated());
+    }
+    return camera.transformationMatrix();
+}
+
+QVector3D toLab(QRgb rgb)
+{
+    const auto linear = [] (int value)
+    {
+        const float c = value / 255.0f;
+        return (c < 0.04045f) ? (c / 12.92f) : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    };
+    const float r = linear(qRed(rgb));
+    const float g = linear(qGreen(rgb));
+    const float b = linear(qBlue(rgb));
+    // sRGB to XYZ normalized by D65 white point
+    const float x = (0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.95047f;
+    const float y = (0.2126f * r + 0.7152f * g + 0.0722f * b);
+    const float z = (0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.08883f;
+    const auto f = [] (float t)
+    {
+        return (t > 216.0f / 24389.0f) ? std::cbrt(t) : ((24389.0f / 27.0f) * t + 16.0f) / 116.0f;
+    };
+    return {116.0f * f(y) - 16.0f, 500.0f * (f(x) - f(y)), 200.0f * (f(y) - f(z))};
+}
+
+struct ImageDifference
+{
+
+    double mean = 0.0;
+    double differentPixels = 0.0; // fraction of pixels with difference above the threshold
+    QImage image;
+
+};
+
+ImageDifference compare(const QImage & actual, const QImage & expected)
+{
+    Q_ASSERT(actual.size() == expected.size());
+    ImageDifference difference;
+    difference.image = QImage{actual.size(), QImage::Format_Grayscale8};
+    qint64 differentPixels = 0;
+    for (int y = 0; y < actual.height(); ++y) {
+        const auto actualLine = reinterpret_cast< const QRgb * >(actual.constScanLine(y));
+        const auto expectedLine = reinterpret_cast< const QRgb * >(expected.constScanLine(y));
+        const auto differenceLine = difference.image.scanLine(y);
+        for (int x = 0; x < actual.width(); ++x) {
+            const double deltaE = double((toLab(actualLine[x]) - toLab(expectedLine[x])).length());
+            difference.mean += deltaE;
+            if (differenceThreshold < deltaE) {
+                ++differentPixels;
+            }
+            differenceLine[x] = uchar(qMin(255.0, deltaE * 255.0 / differenceThreshold));
+        }
+    }
+    const double pixelCount = double(actual.width()) * actual.height();
+    difference.mean /= pixelCount;
+    difference.differentPixels = differentPixels / pixelCount;
+    return difference;
+}
+
+}
+
+class RegressionTest
+        : public QObject
+{
+
+    Q_OBJECT
+
+    QTemporaryDir sceneDirectory;
+    QDir outputDirectory = QDir::current();
+    QString baselineFileName;
+    QJsonObject baseline;
+    bool baselineChanged = false;
+
+    QString sceneFileName(const QString & sceneName) const
+    {
+        return sceneDirectory.filePath(sceneName + QStringLiteral(".rbin"));
+    }
+
+private Q_SLOTS :
+
+    void initTestCase()
+    {
+        if (!CUDA_init()) {
+            QSKIP("no CUDA device capable to map host memory");
+        }
+        QVERIFY(sceneDirectory.isValid());
+        auto sphere = sphereScene(40000);
+        QVERIFY(writeScene(sceneFileName(QStringLiteral("sphere")), sphere, 0.02f));
+        auto box = boxScene();
+        QVERIFY(writeScene(sceneFileName(QStringLiteral("box")), box, 0.025f));
+
+        baselineFileName = QString::fromLocal8Bit(qgetenv("RENDERER_PERFORMANCE_BASELINE"));
+        if (baselineFileName.isEmpty()) {
+            const QDir dataDirectory{QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)};
+            QVERIFY(dataDirectory.mkpath(QStringLiteral(".")));
+            baselineFileName = dataDirectory.filePath(QStringLiteral("performance-%1.json").arg(QSysInfo::machineHostName()));
+        }
+        QFile baselineFile{baselineFileName};
+        if (baselineFile.open(QFile::ReadOnly)) {
+            QJsonParseError error;
+            baseline = QJsonDocument::fromJson(baselineFile.readAll(), &error).object();
+            QVERIFY2(error.error == QJsonParseError::NoError, qPrintable(error.errorString()));
+        }
+        qInfo() << QStringLiteral("performance baseline %1 contains %2 cases").arg(baselineFileName).arg(baseline.size());
+    }
+
+    void cleanupTestCase()
+    {
+        if (!baselineChanged) {
+            return;
+        }
+        QSaveFile baselineFile{baselineFileName};
+        QVERIFY(baselineFile.open(QFile::WriteOnly));
+        baselineFile.write(QJsonDocument{baseline}.toJson());
+        QVERIFY(baselineFile.commit());
+        qInfo() << QStringLiteral("performance baseline is written to %1").arg(baselineFileName);
+    }
+
+    void render_data()
+    {
+        QTest::addColumn< QString >("sceneName");
+        QTest::addColumn< int >("pose");
+        QTest::addColumn< int >("shadingMode");
+
+        const char * const shadingNames[] = {"headlight", "shadow", "occlusion"};
+        for (int pose = 0; pose < int(std::size(poses)); ++pose) {
+            QTest::addRow("sphere-%s-%s", poses[pose].name, shadingNames[HeadlightShading]) << QStringLiteral("sphere") << pose << int(HeadlightShading);
+        }
+        // convex sphere neither casts shadows on itself nor occludes itself, so the other modes are checked on the box standing on the ground
+        for (int pose = 0; pose < int(std::size(poses)); ++pose) {
+            for (int shadingMode : {HeadlightShading, ShadowShading, AmbientOcclusionShading}) {
+                QTest::addRow("box-%s-%s", poses[pose].name, shadingNames[shadingMode]) << QStringLiteral("box") << pose << shadingMode;
+            }
+        }
+    }
+
+    void render()
+    {
+        QFETCH(QString, sceneName);
+        QFETCH(int, pose);
+        QFETCH(int, shadingMode);
+
+        const QString caseName = QString::fromLatin1(QTest::currentDataTag());
+
+        SceneFile sceneFile;
+        QVERIFY(sceneFile.setSource(QUrl::fromLocalFile(sceneFileName(sceneName))));
+
+        RenderParameters parameters = {};
+        parameters.scene = sceneFile.devicePointer();
+        parameters.shading = shading(ShadingMode(shadingMode));
+        const auto inverseTransformationMatrix = windowToWorldMatrix(transformationMatrix(poses[pose]), frameSize);
+        std::copy_n(inverseTransformationMatrix.constData(), 16, parameters.inverseTransformationMatrix);
+
+        std::vector< float > pixels(std::size_t(frameSize.width()) * frameSize.height() * 3);
+
+        // scratch buffers are grow-only, so they are released to measure how much the frames take
+        QVERIFY(CUDA_releaseDeviceBuffers());
+        std::size_t memoryBefore = 0;
+        QVERIFY(CUDA_deviceMemoryUsed(&memoryBefore));
+        std::size_t memoryPeak = memoryBefore;
+        QVector< qint64 > frameTimes;
+        for (int i = 0; i < frameRepeats; ++i) {
+            QElapsedTimer elapsedTimer;
+            elapsedTimer.start();
+            QVERIFY(CUDA_renderToHost(pixels.data(), parameters, 0, 0, frameSize.width(), frameSize.height()));
+            frameTimes.append(elapsedTimer.nsecsElapsed());
+            std::size_t memoryUsed = 0;
+            QVERIFY(CUDA_deviceMemoryUsed(&memoryUsed));
+            memoryPeak = std::max(memoryPeak, memoryUsed);
+        }
+        const quint64 deviceMemory = memoryPeak - memoryBefore;
+        std::nth_element(frameTimes.begin(), frameTimes.begin() + frameTimes.size() / 2, frameTimes.end());
+        const qint64 frameTime = frameTimes.at(frameTimes.size() / 2);
+        qInfo() << QStringLiteral("%1: median frame time %2 ms, device memory %3 bytes").arg(caseName).arg(frameTime * 1E-6).arg(deviceMemory);
+
+        const QImage image = frameImage(pixels.data(), frameSize).convertToFormat(QImage::Format_RGB32);
+        const QString goldenFileName = QDir{QStringLiteral(GOLDEN_DIRECTORY)}.filePath(caseName + QStringLiteral(".png"));
+        if (isEnvironmentSet("RENDERER_UPDATE_GOLDEN")) {
+            QVERIFY(QDir{}.mkpath(QStringLiteral(GOLDEN_DIRECTORY)));
+            QVERIFY(image.save(goldenFileName));
+        }
+
+        const QString actualFileName = outputDirectory.filePath(caseName + QStringLiteral(".actual.png"));
+        QStringList missing;
+        QImage golden;
+        if (golden.load(goldenFileName)) {
+            QCOMPARE(golden.size(), image.size());
+            const auto difference = compare(image, golden.convertToFormat(QImage::Format_RGB32));
+            if ((meanDifferenceTolerance < difference.mean) || (differentPixelsTolerance < difference.differentPixels)) {
+                QVERIFY(image.save(actualFileName));
+                QVERIFY(difference.image.save(outputDirectory.filePath(caseName + QStringLiteral(".difference.png"))));
+                QFAIL(qPrintable(QStringLiteral("image differs from golden one: mean difference %1, %2% of pixels are different, see %3")
+                                 .arg(difference.mean).arg(difference.differentPixels * 100.0).arg(actualFileName)));
+            }
+        } else {
+            QVERIFY(image.save(actualFileName));
+            missing << QStringLiteral("no golden image %1 (rendered one is written to %2), run with RENDERER_UPDATE_GOLDEN=1 on a CUDA device to record it").arg(goldenFileName, actualFileName);
+        }
+
+        const QJsonObject expected = baseline.value(caseName).toObject();
+        if (isEnvironmentSet("RENDERER_UPDATE_BASELINE")) {
+            baseline.insert(caseName, QJsonObject{{QStringLiteral("frameTime"), double(frameTime)}, {QStringLiteral("deviceMemory"), double(deviceMemory)}});
+            baselineChanged = true;
+        } else if (expected.isEmpty()) {
+            missing << QStringLiteral("no performance baseline of %1 in %2, run with RENDERER_UPDATE_BASELINE=1 to record it").arg(caseName, baselineFileName);
+        } else {
+            const double expectedFrameTime = expected.value(QStringLiteral("frameTime")).toDouble();
+            const double expectedDeviceMemory = expected.value(QStringLiteral("deviceMemory")).toDouble();
+            QVERIFY2(!(expectedFrameTime * frameTimeTolerance < frameTime),
+                     qPrintable(QStringLiteral("frame time %1 ms exceeds baseline %2 ms").arg(frameTime * 1E-6).arg(expectedFrameTime * 1E-6)));
+            QVERIFY2(!(expectedDeviceMemory * memoryTolerance < deviceMemory),
+                     qPrintable(QStringLiteral("device memory %1 bytes exceeds baseline %2 bytes").arg(deviceMemory).arg(expectedDeviceMemory)));
+        }
+        if (!missing.isEmpty()) {
+            QSKIP(qPrintable(missing.join(QStringLiteral("; "))));
+        }
+    }
+
+};
+
+QTEST_GUILESS_MAIN(RegressionTest)
+
+#include "tst_regression.moc"
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <QtCore>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+struct MemoryStatistics
+{
+
+    std::size_t current = 0; // bytes handed out and not yet returned
+    std::size_t peak = 0;
+    std::size_t reserved = 0; // bytes obtained from the system
+    std::size_t allocations = 0;
+
+    void allocated(std::size_t size)
+    {
+        current += size;
+        if (peak < current) {
+            peak = current;
+        }
+        ++allocations;
+    }
+
+    void freed(std::size_t size)
+    {
+        Q_ASSERT(!(current < size));
+        current -= size;
+    }
+
+};
+
+// bump allocator: allocations are never freed one by one, the whole arena is reset at once
+// blocks are retained on reset, so steady state (e.g. per-frame scratch memory) allocates nothing from the system
+class Arena
+{
+
+    struct Block
+    {
+        std::unique_ptr< unsigned char[] > data;
+        std::size_t size;
+    };
+
+    std::size_t blockSize;
+    std::vector< Block > blocks;
+    std::size_t blockIndex = 0;
+    std::size_t offset = 0;
+
+    MemoryStatistics memoryStatistics;
+
+    static
+    std::size_t padding(const unsigned char * p, std::size_t alignment)
+    {
+        Q_ASSERT((alignment & (alignment - 1)) == 0);
+        return std::size_t(-reinterpret_cast< std::uintptr_t >(p)) & (alignment - 1);
+    }
+
+public :
+
+    explicit
+    Arena(std::size_t blockSize = std::size_t(1) << 20)
+        : blockSize{blockSize}
+    { ; }
+
+    Arena(const Arena &) = delete;
+    Arena & operator = (const Arena &) = delete;
+
+    void * allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t))
+    {
+        while (blockIndex < blocks.size()) {
+            const auto & block = blocks[blockIndex];
+            const auto p = block.data.get() + offset;
+            const auto skip = padding(p, alignment);
+            if (!(block.size - offset < skip + size)) {
+                offset += skip + size;
+                memoryStatistics.allocated(skip + size);
+                return p + skip;
+            }
+            ++blockIndex;
+            offset = 0;
+        }
+        const auto size_ = std::max(blockSize, size + alignment);
+        blocks.push_back({std::unique_ptr< unsigned char[] >{new unsigned char[size_]}, size_});
+        memoryStatistics.reserved += size_;
+        blockIndex = blocks.size() - 1;
+        const auto p = blocks.back().data.get();
+        const auto skip = padding(p, alignment);
+        offset = skip + size;
+        memoryStatistics.allocated(skip + size);
+        return p + skip;
+    }
+
+    template< typename Type >
+    Type * allocate(std::size_t count)
+    {
+        return static_cast< Type * >(allocate(sizeof(Type) * count, alignof(Type)));
+    }
+
+    // objects allocated from the arena must be trivially destructible or destroyed beforehand
+    void reset()
+    {
+        blockIndex = 0;
+        offset = 0;
+        memoryStatistics.freed(memoryStatistics.current);
+    }
+
+    void release()
+    {
+        reset();
+        blocks.clear();
+        memoryStatistics.reserved = 0;
+    }
+
+    const MemoryStatistics & statistics() const
+    {
+        return memoryStatistics;
+    }
+
+};
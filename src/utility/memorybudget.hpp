@@ -0,0 +1,247 @@
+#pragma once
+
+#include <QtCore>
+
+#include <functional>
+#include <utility>
+
+#include <cstdint>
+
+inline
+const QLoggingCategory & memoryBudgetCategory()
+{
+    static const QLoggingCategory category{"memoryBudget"};
+    return category;
+}
+
+// process-wide accountant of large allocations (host memory pinned for the device, device and GL buffers, caches)
+// owners request memory before allocating it; if the request does not fit into the budget, caches are evicted first,
+// then the request is refused and the owner is expected to degrade (e.g. to allocate smaller frame)
+class MemoryBudget
+{
+
+public :
+
+    enum Category
+    {
+        PinnedScene, // mapped scene file registered for access from the device
+        AccelerationData,
+        FrameBuffers,
+        DeviceBuffers,
+        Caches,
+        CategoryCount
+    };
+
+    static
+    const char * categoryName(Category category)
+    {
+        static const char * const names[CategoryCount] = {"pinnedScene", "accelerationData", "frameBuffers", "deviceBuffers", "caches"};
+        return names[category];
+    }
+
+    struct Statistics
+    {
+
+        quint64 budget = 0; // zero means unlimited
+        quint64 used = 0;
+        quint64 peak = 0;
+        quint64 categories[CategoryCount] = {};
+        quint64 evictions = 0;
+        quint64 refusals = 0;
+        quint64 revision = 0; // incremented on every change
+
+    };
+
+    // evictor frees memory of its owner (and returns it to the budget) when called
+    // it is called on the thread requesting memory, so evictable memory should be used on that thread only
+    int addEvictor(std::function< void () > evictor)
+    {
+        QMutexLocker lock{&mutex};
+        evictors.append({++evictorId, std::move(evictor)});
+        return evictorId;
+    }
+
+    void removeEvictor(int id)
+    {
+        QMutexLocker lock{&mutex};
+        for (int i = 0; i < evictors.size(); ++i) {
+            if (evictors.at(i).first == id) {
+                evictors.remove(i);
+                return;
+            }
+        }
+    }
+
+    void setBudget(quint64 budget)
+    {
+        {
+            QMutexLocker lock{&mutex};
+            if (statistics_.budget == budget) {
+                return;
+            }
+            statistics_.budget = budget;
+            ++statistics_.revision;
+            qCInfo(memoryBudgetCategory) << QStringLiteral("budget is set to %1 bytes, %2 bytes are in use").arg(budget).arg(statistics_.used);
+        }
+        if (!fits(0)) {
+            evict(0);
+            if (!fits(0)) {
+                qCWarning(memoryBudgetCategory) << QStringLiteral("%1 bytes in use exceed the budget of %2 bytes").arg(statistics().used).arg(budget);
+            }
+        }
+    }
+
+    // accounts the memory if it fits into the budget, possibly after eviction of caches
+    bool tryAllocate(Category category, quint64 size)
+    {
+        if (!fits(size)) {
+            evict(size);
+        }
+        QMutexLocker lock{&mutex};
+        if (!fitsLocked(size)) {
+            ++statistics_.refusals;
+            ++statistics_.revision;
+            qCInfo(memoryBudgetCategory) << QStringLiteral("request for %1 bytes of %2 is refused: %3 of %4 bytes are in use")
+                                            .arg(size).arg(categoryName(category)).arg(statistics_.used).arg(statistics_.budget);
+            return false;
+        }
+        allocateLocked(category, size);
+        return true;
+    }
+
+    // for allocations the owner cannot do without or which are already made: accounted even if the budget is exceeded
+    // nothing is evicted, so it is safe to call while caches are in use
+    void allocate(Category category, quint64 size)
+    {
+        QMutexLocker lock{&mutex};
+        if (!fitsLocked(size)) {
+            qCWarning(memoryBudgetCategory) << QStringLiteral("%1 bytes of %2 exceed the budget: %3 of %4 bytes are in use")
+                                               .arg(size).arg(categoryName(category)).arg(statistics_.used).arg(statistics_.budget);
+        }
+        allocateLocked(category, size);
+    }
+
+    void free(Category category, quint64 size)
+    {
+        QMutexLocker lock{&mutex};
+        Q_ASSERT(!(statistics_.categories[category] < size));
+        statistics_.categories[category] -= size;
+        statistics_.used -= size;
+        ++statistics_.revision;
+    }
+
+    Statistics statistics() const
+    {
+        QMutexLocker lock{&mutex};
+        return statistics_;
+    }
+
+private :
+
+    mutable QMutex mutex;
+    Statistics statistics_;
+    int evictorId = 0;
+    QVector< QPair< int, std::function< void () > > > evictors;
+
+    bool fitsLocked(quint64 size) const
+    {
+        return (statistics_.budget == 0) || !(statistics_.budget - qMin(statistics_.budget, statistics_.used) < size);
+    }
+
+    bool fits(quint64 size) const
+    {
+        QMutexLocker lock{&mutex};
+        return fitsLocked(size);
+    }
+
+    void allocateLocked(Category category, quint64 size)
+    {
+        statistics_.categories[category] += size;
+        statistics_.used += size;
+        statistics_.peak = qMax(statistics_.peak, statistics_.used);
+        ++statistics_.revision;
+    }
+
+    // evictors account freed memory themselves, so they are called without the lock held
+    void evict(quint64 size)
+    {
+        decltype(evictors) evictors;
+        {
+            QMutexLocker lock{&mutex};
+            evictors = this->evictors;
+        }
+        for (const auto & evictor : qAsConst(evictors)) {
+            if (fits(size)) {
+                return;
+            }
+            const auto used = statistics().used;
+            evictor.second();
+            QMutexLocker lock{&mutex};
+            if (statistics_.used < used) {
+                ++statistics_.evictions;
+                ++statistics_.revision;
+                qCDebug(memoryBudgetCategory) << QStringLiteral("cache is evicted: %1 bytes are freed, %2 bytes are in use").arg(used - statistics_.used).arg(statistics_.used);
+            }
+        }
+    }
+
+};
+
+inline
+MemoryBudget & memoryBudget()
+{
+    static MemoryBudget memoryBudget;
+    return memoryBudget;
+}
+
+// memory of the category accounted by the owner, returned to the budget on destruction
+class MemoryReservation
+{
+
+    MemoryBudget::Category category;
+    quint64 size_ = 0;
+
+public :
+
+    explicit
+    MemoryReservation(MemoryBudget::Category category)
+        : category{category}
+    { ; }
+
+    MemoryReservation(const MemoryReservation &) = delete;
+    MemoryReservation & operator = (const MemoryReservation &) = delete;
+
+    ~MemoryReservation()
+    {
+        resize(0);
+    }
+
+    quint64 size() const
+    {
+        return size_;
+    }
+
+    bool tryResize(quint64 size)
+    {
+        if (size_ < size) {
+            if (!memoryBudget().tryAllocate(category, size - size_)) {
+                return false;
+            }
+        } else if (size < size_) {
+            memoryBudget().free(category, size_ - size);
+        }
+        size_ = size;
+        return true;
+    }
+
+    void resize(quint64 size)
+    {
+        if (size_ < size) {
+            memoryBudget().allocate(category, size - size_);
+        } else if (size < size_) {
+            memoryBudget().free(category, size_ - size);
+        }
+        size_ = size;
+    }
+
+};